@@ -13,15 +13,14 @@
  * Arduino Uno or other ATmega328P-based boards.
  * Arduino Mega or other ATmega2560- or 1280-based boards.
  * Arduino Zero, Adafruit Feather M0 (ATSAMD21).
- * Arduino Leonardo or other 32u4-based boards (e.g. Adafruit Feather) WITH
- * CAVEAT: USB Serial connection is clobbered on sleep; if sketch does not
- * require Serial comms, this is not a concern. The example sketches all print
- * to Serial and appear frozen, but the logic does otherwise continue to run.
- * You can restore the USB serial connection after waking up using
- * `USBDevice.attach();` and then reconnect to USB serial from the host machine.
- * Partial support for Teensy 3.X and LC (watchdog, no sleep).
+ * Arduino Leonardo or other 32u4-based boards (e.g. Adafruit Feather), which
+ * sleep in idle mode to keep USB up while connected to a host.
+ * Teensy 3.X and LC (sleep is not available on Teensy 3.6 above 120 MHz).
+ * Teensy 4.0/4.1
  * ESP32/ESP32-S2
  * ESP8266
+ * STM32 on the STM32duino core (sleep on STM32F4 only, e.g. Feather F405)
+ * Linux, as a systemd service with WatchdogSec=
  *
  * Adafruit Trinket and other boards using ATtiny MCUs are NOT supported.
  */
@@ -25,6 +25,10 @@ typedef WatchdogKinetisKseries WatchdogType;
 // Teensy LC watchdog support.
 #include "utility/WatchdogKinetisL.h"
 typedef WatchdogKinetisLseries WatchdogType;
+#elif defined(__IMXRT1062__)
+// Teensy 4.x watchdog support.
+#include "utility/WatchdogIMXRT.h"
+typedef WatchdogIMXRT WatchdogType;
 #elif defined(NRF52_SERIES)
 #include "utility/WatchdogNRF.h"
 typedef WatchdogNRF WatchdogType;
@@ -37,10 +41,58 @@ typedef WatchdogESP8266 WatchdogType;
 #elif defined(ARDUINO_ARCH_RP2040)
 #include "utility/WatchdogRP2040.h"
 typedef WatchdogRP2040 WatchdogType;
+#elif defined(ARDUINO_ARCH_STM32)
+// STM32duino core, independent watchdog (IWDG).
+#include "utility/WatchdogSTM32.h"
+typedef WatchdogSTM32 WatchdogType;
+#elif defined(__linux__)
+// systemd service watchdog, for sketches built for Linux.
+#include "utility/WatchdogSystemd.h"
+#include "utility/WatchdogThreads.h"
+typedef WatchdogSystemd WatchdogType;
 #else
 #error Unsupported platform for the Adafruit Watchdog library!
 #endif
 
 extern WatchdogType Watchdog;
 
+/**************************************************************************/
+/*!
+    @brief  Lengthens the watchdog timeout for as long as the guard is in
+            scope, around a known long operation (flash erase, SD write...)
+            that would otherwise force a much longer timeout everywhere:
+
+                {
+                  WatchdogExtend guard(5000);
+                  file.write(buffer, sizeof(buffer));
+                }
+
+            The tight timeout is back (and the watchdog kicked) when the
+            guard goes out of scope.  Where the hardware can be reprogrammed
+            cheaply the new timeout is rounded and capped like enable()'s;
+            where it's write-once (nRF52, Teensy LC) an interrupt feeds the
+            watchdog until the extended deadline instead.  Guards nest.
+*/
+/**************************************************************************/
+class WatchdogExtend {
+public:
+  /*!
+      @brief  Extends the timeout.
+      @param  maxPeriodMS
+              Timeout (in milliseconds) for the lifetime of the guard.
+  */
+  explicit WatchdogExtend(int maxPeriodMS)
+      : _prev(Watchdog.extend(maxPeriodMS)) {}
+  /*!
+      @brief  Goes back to the previous timeout.
+  */
+  ~WatchdogExtend() { Watchdog.restore(_prev); }
+
+  WatchdogExtend(const WatchdogExtend &) = delete;
+  WatchdogExtend &operator=(const WatchdogExtend &) = delete;
+
+private:
+  int _prev;
+};
+
 #endif
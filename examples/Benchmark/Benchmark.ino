@@ -0,0 +1,180 @@
+// Adafruit Watchdog Library Benchmark Example
+//
+// Measures what the library costs on this board and prints it as CSV
+// (board,metric,value,unit), to compare platforms and catch regressions:
+//
+// - reset_cycles, reset_if_due_cycles: average cost of a kick, call and
+//   loop included.
+// - enable_us: average time enable() takes to (re)program the watchdog.
+// - sleep_overhead_us: time sleep() spends awake going to sleep and waking
+//   back up, on top of the time asleep.
+// - sleep_ms: time actually asleep when asked for SLEEP_MS, where the
+//   clock keeps running during sleep.
+// - period_ms: time the watchdog actually takes to bite after enable() was
+//   asked for PERIOD_MS (and programmed period_programmed_ms).  The board
+//   stalls and gets reset for this one, then prints it on the way back up.
+//
+// USB boards may drop off the bus while asleep or resetting, so keep a
+// terminal that reconnects by itself (or a serial bridge) on the port.
+
+#include <Adafruit_SleepyDog.h>
+
+#define KICKS 1000
+#define ENABLES 10
+#define SLEEPS 5
+#define SLEEP_MS 100
+#define PERIOD_MS 1000
+
+// millis() doesn't count the time in sleep() on these, so whatever time
+// goes by around sleep() is time spent awake.  32u4 boards only power down
+// (and stop it) while no host has USB up, idle sleep keeps it counting.
+static bool clockStopsInSleep() {
+#if defined(ARDUINO_ARCH_AVR) && defined(USBCON)
+  return !(USBDevice.configured() && !(UDIEN & _BV(WAKEUPE)));
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Survives the watchdog reset that ends the period measurement.
+struct BenchState {
+  uint32_t programmedMS; // Period enable() returned
+  uint32_t elapsedMS;    // Time stalled so far, updated until the reset
+};
+
+static uint32_t cpuMHz() {
+#if defined(ARDUINO_ARCH_ESP32)
+  return getCpuFrequencyMhz();
+#else
+  return F_CPU / 1000000;
+#endif
+}
+
+static const char *board() {
+#if defined(ARDUINO_ARCH_AVR)
+  return "avr";
+#elif defined(__SAMD51__)
+  return "samd51";
+#elif defined(ARDUINO_ARCH_SAMD)
+  return "samd21";
+#elif defined(KINETISK)
+  return "teensy3";
+#elif defined(KINETISL)
+  return "teensylc";
+#elif defined(__IMXRT1062__)
+  return "teensy4";
+#elif defined(NRF52_SERIES)
+  return "nrf52";
+#elif defined(ARDUINO_ARCH_ESP32)
+  return "esp32";
+#elif defined(ARDUINO_ARCH_ESP8266)
+  return "esp8266";
+#elif defined(ARDUINO_ARCH_RP2040)
+  return "rp2040";
+#elif defined(ARDUINO_ARCH_STM32)
+  return "stm32";
+#else
+  return "unknown";
+#endif
+}
+
+static void row(const char *metric, uint32_t value, const char *unit) {
+  Serial.print(board());
+  Serial.print(',');
+  Serial.print(metric);
+  Serial.print(',');
+  Serial.print(value);
+  Serial.print(',');
+  Serial.println(unit);
+}
+
+static void benchKicks() {
+  Watchdog.enable(4000);
+
+  uint32_t start = micros();
+  for (int i = 0; i < KICKS; i++)
+    Watchdog.reset();
+  uint32_t us = micros() - start;
+  row("reset_cycles", (uint64_t)us * cpuMHz() / KICKS, "cycles");
+
+  start = micros();
+  for (int i = 0; i < KICKS; i++)
+    Watchdog.resetIfDue();
+  us = micros() - start;
+  row("reset_if_due_cycles", (uint64_t)us * cpuMHz() / KICKS, "cycles");
+
+  // nRF52's watchdog can't be reprogrammed once started, and on RP2040
+  // this is the only way to change the period, so both count as well.
+  start = micros();
+  for (int i = 0; i < ENABLES; i++)
+    Watchdog.enable(4000);
+  us = micros() - start;
+  row("enable_us", us / ENABLES, "us");
+}
+
+static void benchSleep() {
+#if defined(ARDUINO_ARCH_ESP8266)
+  // sleep() is a deep sleep that wakes up through a reset.
+  return;
+#else
+  Serial.flush();
+  uint32_t overheadUS = 0, sleptMS = 0;
+  bool clockStops = clockStopsInSleep();
+  for (int i = 0; i < SLEEPS; i++) {
+    uint32_t start = micros();
+    int ms = Watchdog.sleep(SLEEP_MS);
+    uint32_t us = micros() - start;
+    if (ms <= 0)
+      return; // Can't sleep on this board (or in this mode)
+    if (clockStops) {
+      overheadUS += us;
+      sleptMS += ms;
+    } else {
+      overheadUS += us > ms * 1000UL ? us - ms * 1000UL : 0;
+      sleptMS += us / 1000;
+    }
+  }
+  row("sleep_overhead_us", overheadUS / SLEEPS, "us");
+  if (!clockStops)
+    row("sleep_ms", sleptMS / SLEEPS, "ms");
+#endif
+}
+
+static void benchPeriod() {
+  Serial.println("# stalling until the watchdog resets the board...");
+  Serial.flush();
+  BenchState state = {0, 0};
+  state.programmedMS = Watchdog.enable(PERIOD_MS);
+  uint32_t start = millis();
+  // Keep a record of how long the stall lasted until the reset cuts it
+  // short, the next run reports the last one saved.
+  for (;;) {
+    state.elapsedMS = millis() - start;
+    Watchdog.saveState(&state, sizeof(state));
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial && millis() < 5000)
+    delay(10);
+  // wait for Arduino Serial Monitor (native USB boards)
+
+  BenchState state;
+  if (Watchdog.restoreState(&state, sizeof(state))) {
+    row("period_ms", state.elapsedMS, "ms");
+    row("period_requested_ms", PERIOD_MS, "ms");
+    row("period_programmed_ms", state.programmedMS, "ms");
+    Serial.println("# done");
+    return;
+  }
+
+  Serial.println("board,metric,value,unit");
+  benchKicks();
+  benchSleep();
+  benchPeriod();
+}
+
+void loop() {}
@@ -0,0 +1,67 @@
+// Adafruit Watchdog Library Crash Report Example
+//
+// Simple example of how to find out why and where the watchdog reset the
+// board, using breadcrumbs.
+
+#include <Adafruit_SleepyDog.h>
+
+// Phase markers, any value from 1 to 255.
+#define PHASE_SETUP 1
+#define PHASE_READ 2
+#define PHASE_HANG 3
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    delay(10);
+  // wait for Arduino Serial Monitor (native USB boards)
+
+  Serial.println("Adafruit Watchdog Library Crash Report Demo!");
+  Serial.println();
+
+  // Find out what happened before this reset.  After a watchdog reset the
+  // breadcrumbs show which phases the sketch went through last, and on
+  // most boards the address it was stuck at is captured too.
+  WatchdogResetInfo info;
+  Watchdog.lastReset(info);
+  Serial.print("Reset cause: ");
+  Serial.println(info.cause == WATCHDOG_RESET_WATCHDOG ? "watchdog" : "other");
+  if (info.captured) {
+    Serial.print("Stuck at address 0x");
+    Serial.println(info.pc, HEX);
+  }
+  Serial.print("Breadcrumbs:");
+  for (int i = 0; i < info.count; i++) {
+    Serial.print(' ');
+    Serial.print(info.crumbs[i], DEC);
+  }
+  Serial.println();
+  Serial.println();
+
+  Watchdog.crumb(PHASE_SETUP);
+#ifdef ARDUINO_ARCH_AVR
+  // The AVR only notes the address when asked to.
+  Watchdog.setCapture(true);
+#endif
+  int countdownMS = Watchdog.enable(4000);
+  Serial.print("Enabled the watchdog with max countdown of ");
+  Serial.print(countdownMS, DEC);
+  Serial.println(" milliseconds!");
+}
+
+void loop() {
+  // Stamping a breadcrumb is just a couple of stores into RAM that survives
+  // a reset, so it's fine to leave them in the main loop.
+  Watchdog.crumb(PHASE_READ);
+  delay(500);
+  Watchdog.reset();
+
+  // Simulate a hang after a while, the watchdog will reset the board and
+  // the next run prints the report above.
+  if (millis() > 10000) {
+    Serial.println("Hanging...");
+    Watchdog.crumb(PHASE_HANG);
+    while (true) {
+    }
+  }
+}
@@ -0,0 +1,94 @@
+// Adafruit Watchdog Library Kick Latency Example
+//
+// Teensy 3.x and LC only: measures the worst case time each way of kicking
+// the watchdog takes.  reset() masks interrupts for about that long, so it
+// bounds the latency it can add to any interrupt, however high its
+// priority.  resetLowLatency() doesn't mask them at all.
+
+#include <Adafruit_SleepyDog.h>
+
+#if defined(KINETISK) || defined(KINETISL)
+
+#define KICKS 10000
+
+// SysTick counts core clock cycles down from SYST_RVR to 0, every ms.
+static uint32_t elapsed(uint32_t start, uint32_t end) {
+  return start >= end ? start - end : start + SYST_RVR + 1 - end;
+}
+
+// Every interrupt source is switched off in the NVIC (SysTick's too) while
+// timing, so none of them gets counted in.  Masking them globally won't do:
+// reset() turns them back on as it returns, and anything pending would run
+// before the end of the timed window.
+static uint32_t enabled[(NVIC_NUM_INTERRUPTS + 31) / 32];
+
+static void quiet() {
+  SYST_CSR &= ~SYST_CSR_TICKINT;
+  for (unsigned i = 0; i < sizeof(enabled) / sizeof(enabled[0]); i++) {
+    enabled[i] = (&NVIC_ISER0)[i];
+    (&NVIC_ICER0)[i] = enabled[i];
+  }
+}
+
+static void unquiet() {
+  for (unsigned i = 0; i < sizeof(enabled) / sizeof(enabled[0]); i++)
+    (&NVIC_ISER0)[i] = enabled[i];
+  SYST_CSR |= SYST_CSR_TICKINT;
+}
+
+static void report(const char *name, uint32_t cycles) {
+  Serial.print(name);
+  Serial.print(cycles);
+  Serial.print(" cycles (");
+  Serial.print(cycles * 1000 / (F_CPU / 1000000));
+  Serial.println(" ns)");
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    delay(10);
+  // wait for Arduino Serial Monitor (native USB boards)
+
+  Serial.println("Adafruit Watchdog Library Kick Latency Demo!");
+  Serial.println();
+
+  Watchdog.enable(4000);
+}
+
+void loop() {
+  uint32_t worstReset = 0, worstLowLatency = 0;
+
+  for (int i = 0; i < KICKS; i++) {
+    quiet();
+    uint32_t start = SYST_CVR;
+    Watchdog.resetLowLatency();
+    uint32_t cycles = elapsed(start, SYST_CVR);
+    if (cycles > worstLowLatency)
+      worstLowLatency = cycles;
+
+    start = SYST_CVR;
+    Watchdog.reset();
+    cycles = elapsed(start, SYST_CVR);
+    if (cycles > worstReset)
+      worstReset = cycles;
+    unquiet();
+  }
+
+  // Includes the call and the timing itself, so this is an upper bound.
+  report("Worst case reset():           ", worstReset);
+  report("Worst case resetLowLatency(): ", worstLowLatency);
+  Serial.println();
+  delay(1000);
+}
+
+#else
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("This example only runs on Teensy 3.x and LC.");
+}
+
+void loop() {}
+
+#endif
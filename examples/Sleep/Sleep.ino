@@ -8,10 +8,10 @@
 
 void setup() {
   // For boards with "native" USB support (e.g. not using an FTDI chip or
-  // similar serial bridge), Serial connection may be lost on sleep/wake,
-  // and you might not see the "I'm awake" messages. Use the onboard LED
-  // as an alternate indicator -- the code turns it on when awake, off
-  // before going to sleep.
+  // similar serial bridge), Serial connection may be lost on sleep/wake
+  // (32u4 boards keep it, sleeping lighter while connected), and you might
+  // not see the "I'm awake" messages. Use the onboard LED as an alternate
+  // indicator -- the code turns it on when awake, off before going to sleep.
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, HIGH); // Show we're awake
 
@@ -45,8 +45,10 @@ void loop() {
 
   // Try to reattach USB connection on "native USB" boards (connection is
   // lost on sleep). Host will also need to reattach to the Serial monitor.
-  // Seems not entirely reliable, hence the LED indicator fallback.
-#if defined(USBCON) && !defined(USE_TINYUSB)
+  // Seems not entirely reliable, hence the LED indicator fallback.  On 32u4
+  // boards, sleep() keeps USB up while connected to a host, and otherwise
+  // attaches it again on wake itself.
+#if defined(USBCON) && !defined(USE_TINYUSB) && !defined(ARDUINO_ARCH_AVR)
   USBDevice.attach();
 #endif
 
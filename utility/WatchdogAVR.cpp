@@ -10,68 +10,231 @@
 
 #include "WatchdogAVR.h"
 
-// Define watchdog timer interrupt.
-ISR(WDT_vect) {
-  // Nothing needs to be done, however interrupt handler must be defined to
-  // prevent a reset.
+// Older megas call the reset flags register MCUCSR.
+#if !defined(MCUSR) && defined(MCUCSR)
+#define MCUSR MCUCSR
+#endif
+
+// Reset flags as they were at boot.  Must live in .noinit: .init3 runs
+// before .bss is cleared.
+static uint8_t _resetFlags __attribute__((section(".noinit")));
+
+// Save the reset flags before anything else runs.  MCUSR is left alone for
+// the sketch to read (and clear) as well, so flags from earlier resets stay
+// set until something clears them.  Optiboot clears it itself but hands the
+// original value over in r2, which nothing touched yet; with MCUSR already
+// clear, that's the only place left to look (other bootloaders that clear
+// it leave whatever r2 held).
+void _watchdogSaveResetFlags(void)
+    __attribute__((naked, used, section(".init3")));
+void _watchdogSaveResetFlags(void) {
+  uint8_t flags = MCUSR;
+  if (!flags)
+    __asm__ __volatile__("mov %0, r2" : "=r"(flags));
+  _resetFlags = flags;
+}
+
+// Word address the watchdog interrupt returned to, most significant byte
+// first (the top byte is only used on parts with a 3 byte PC).
+extern "C" volatile uint8_t _watchdogAvrPC[3];
+volatile uint8_t _watchdogAvrPC[3];
+
+// Soft recovery callback for the first timeout, see setRecoveryCallback(),
+// and whether it already ran since the last reset().
+static void (*volatile _recovery)(void) = 0;
+static volatile bool _escalated = false;
+
+// Whether a missed deadline notes where the code was stuck, see
+// setCapture().
+static bool _capture = false;
+
+// Set by the watchdog interrupt that ends a sleep().
+static volatile bool _sleepDone = false;
+
+// Body of the watchdog interrupt, see below.
+extern "C" void __vector_watchdog(void) __attribute__((signal, used));
+
+// Define watchdog timer interrupt.  It has to be naked in order to pick the
+// interrupted address off the stack before the compiler pushes anything,
+// then it carries on in __vector_watchdog() as a regular interrupt handler.
+ISR(WDT_vect, ISR_NAKED) {
+  __asm__ __volatile__("push r0                    \n\t"
+                       "push r30                   \n\t"
+                       "push r31                   \n\t"
+                       "in r30, __SP_L__           \n\t"
+                       "in r31, __SP_H__           \n\t"
+#if defined(__AVR_3_BYTE_PC__)
+                       "ldd r0, Z+4                \n\t"
+                       "sts _watchdogAvrPC, r0     \n\t"
+                       "ldd r0, Z+5                \n\t"
+                       "sts _watchdogAvrPC+1, r0   \n\t"
+                       "ldd r0, Z+6                \n\t"
+                       "sts _watchdogAvrPC+2, r0   \n\t"
+#else
+                       "ldd r0, Z+4                \n\t"
+                       "sts _watchdogAvrPC+1, r0   \n\t"
+                       "ldd r0, Z+5                \n\t"
+                       "sts _watchdogAvrPC+2, r0   \n\t"
+#endif
+                       "pop r31                    \n\t"
+                       "pop r30                    \n\t"
+                       "pop r0                     \n\t"
+                       "%~jmp __vector_watchdog    \n\t" ::);
+}
+
+void __vector_watchdog(void) {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ISR);
+
+  // In sleep() the watchdog runs in interrupt only mode and only needs to
+  // tell sleep() it went off, however the interrupt handler must be defined
+  // to prevent a reset.
+  if (!(_WD_CONTROL_REG & (1 << WDE))) {
+    _sleepDone = true;
+    return;
+  }
+
+  // Otherwise the watchdog was enabled with the interrupt armed in front of
+  // the reset (see _runMode()), so this is a missed deadline.  The first one
+  // only calls the recovery callback; re-arming the interrupt (which the
+  // hardware cleared) makes the next timeout come back here rather than
+  // reset.
+  if (_recovery && !_escalated) {
+    _escalated = true;
+    _WD_CONTROL_REG |= (1 << WDIE);
+    _recovery();
+    return;
+  }
+
+  // Note where the code was stuck and reset right away rather than waiting
+  // out another period.
+  WatchdogCrumbs::capture((((uint32_t)_watchdogAvrPC[0] << 16) |
+                           ((uint32_t)_watchdogAvrPC[1] << 8) |
+                           _watchdogAvrPC[2])
+                          << 1); // word -> byte address
+  wdt_enable(WDTO_15MS);
+  for (;;)
+    ;
 }
 
 int WatchdogAVR::enable(int maxPeriodMS) {
   // Pick the closest appropriate watchdog timer value.
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
   int actualMS;
   _setPeriod(maxPeriodMS, _wdto, actualMS);
   // Enable the watchdog and return the actual countdown value.
-  wdt_enable(_wdto);
+  _setWDT(_wdto, _runMode());
+  _periodMS = actualMS;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
   return actualMS;
 }
 
+int WatchdogAVR::extend(int maxPeriodMS) {
+  int prev = _periodMS;
+  // Reprogramming is just the timed sequence, which also kicks it.
+  if (prev)
+    enable(maxPeriodMS);
+  return prev;
+}
+
+void WatchdogAVR::restore(int prev) {
+  if (prev)
+    enable(prev);
+}
+
 void WatchdogAVR::reset() {
   // Reset the watchdog.
   wdt_reset();
+  _escalated = false;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+void WatchdogAVR::setRecoveryCallback(void (*callback)(void)) {
+  _recovery = callback;
+  _escalated = false;
+  if (_wdto != -1)
+    _setWDT(_wdto, _runMode());
+}
+
+void WatchdogAVR::setCapture(bool on) {
+  _capture = on;
+  if (_wdto != -1)
+    _setWDT(_wdto, _runMode());
+}
+
+uint8_t WatchdogAVR::_runMode() {
+  // Plain reset mode unless something needs the interrupt, which runs in
+  // front of the reset.  Only then does the hardware switch to resetting,
+  // so with interrupts off at the deadline it never resets.
+  if (_recovery || _capture)
+    return (1 << WDE) | (1 << WDIE);
+  return (1 << WDE);
 }
 
 void WatchdogAVR::disable() {
   // Disable the watchdog and clear any saved watchdog timer value.
   wdt_disable();
   _wdto = -1;
+  _periodMS = 0;
 }
 
 int WatchdogAVR::sleep(int maxPeriodMS) {
   // Pick the closest appropriate watchdog timer value.
   int sleepWDTO, actualMS;
   _setPeriod(maxPeriodMS, sleepWDTO, actualMS);
+  WatchdogEnergy::sleepBegin();
 
-  // Build watchdog prescaler register value before timing critical code.
-  uint8_t wdps = ((sleepWDTO & 0x08 ? 1 : 0) << WDP3) |
-                 ((sleepWDTO & 0x04 ? 1 : 0) << WDP2) |
-                 ((sleepWDTO & 0x02 ? 1 : 0) << WDP1) |
-                 ((sleepWDTO & 0x01 ? 1 : 0) << WDP0);
+#if defined(USBCON) && !defined(USE_TINYUSB)
+  // While a host has the USB device configured (and the bus isn't
+  // suspended, the core waits for a wakeup then), idle sleep keeps the PLL
+  // and USB clock running so the connection survives.  The CPU then wakes
+  // up on every frame and timer 0 tick, and goes back to sleep until the
+  // watchdog interrupt.
+  bool keepUSB = USBDevice.configured() && !(UDIEN & _BV(WAKEUPE));
+  bool usbWasOn = USBCON & _BV(USBE);
+#else
+  bool keepUSB = false;
+#endif
+  // Only a LOW level wakes INTx from power-down, edges aren't even latched
+  // without the I/O clock, so idle sleep waits on those instead.
+  bool idle = keepUSB || WatchdogWake::edges();
+  _sleepDone = false;
 
-  // The next section is timing critical so interrupts are disabled.
-  cli();
   // First clear any previous watchdog reset.
   MCUSR &= ~(1 << WDRF);
   // Now change the watchdog prescaler and interrupt enable bit so the
   // watchdog reset only triggers the interrupt (and wakes from deep sleep)
-  // and not a full device reset.  This is a timing critical section of
-  // code that must happen in 4 cycles.
-  _WD_CONTROL_REG |=
-      (1 << WDCE) | (1 << WDE);   // Set WDCE and WDE to enable changes.
-  _WD_CONTROL_REG = wdps;         // Set the prescaler bit values.
-  _WD_CONTROL_REG |= (1 << WDIE); // Enable only watchdog interrupts.
-  // Critical section finished, re-enable interrupts.
+  // and not a full device reset.
+  _setWDT(sleepWDTO, (1 << WDIE));
   sei();
 
 // Disable USB if it exists
 #ifdef USBCON
-  USBCON |= _BV(FRZCLK); // freeze USB clock
-  PLLCSR &= ~_BV(PLLE);  // turn off USB PLL
-  USBCON &= ~_BV(USBE);  // disable USB
+  if (!keepUSB) {
+    USBCON |= _BV(FRZCLK); // freeze USB clock
+    PLLCSR &= ~_BV(PLLE);  // turn off USB PLL
+    USBCON &= ~_BV(USBE);  // disable USB
+  }
 #endif
 
-  // Set full power-down sleep mode and go to sleep.
-  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-  sleep_mode();
+  // Set full power-down (or idle) sleep mode and go to sleep, unless a
+  // sleepUntil() pin fired already.  The instruction after sei always runs
+  // before any interrupt does, so a pin can't fire between the check and
+  // the sleep.
+  set_sleep_mode(idle ? SLEEP_MODE_IDLE : SLEEP_MODE_PWR_DOWN);
+  uint32_t start = millis();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+  cli();
+  while (!_sleepDone && !WatchdogWake::pending()) {
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    cli();
+    // From power-down, whatever woke the chip up ends the sleep.
+    if (!idle)
+      break;
+  }
+  sei();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
 
   // Chip is now asleep!
 
@@ -81,12 +244,60 @@ int WatchdogAVR::sleep(int maxPeriodMS) {
 
   // Check if user had the watchdog enabled before sleep and re-enable it.
   if (_wdto != -1)
-    wdt_enable(_wdto);
+    _setWDT(_wdto, _runMode());
+
+  // millis() kept counting in idle, it times the sleep better than the
+  // watchdog oscillator.  After power-down, bring USB back up so a host
+  // can enumerate the device again.
+  if (idle)
+    actualMS = millis() - start;
+#if defined(USBCON) && !defined(USE_TINYUSB)
+  if (!keepUSB && usbWasOn)
+    USBDevice.attach();
+#endif
 
   // Return how many actual milliseconds were spent sleeping.
+  WatchdogEnergy::sleepEnd(idle ? WATCHDOG_SLEEP_IDLE : WATCHDOG_SLEEP_STOP,
+                           actualMS, WatchdogWake::pending());
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
   return actualMS;
 }
 
+WatchdogResetCause WatchdogAVR::resetReason() {
+  // More than one flag can be set, the watchdog matters most.
+  if (_resetFlags & (1 << WDRF))
+    return WATCHDOG_RESET_WATCHDOG;
+#if defined(BORF)
+  if (_resetFlags & (1 << BORF))
+    return WATCHDOG_RESET_BROWNOUT;
+#endif
+  if (_resetFlags & (1 << EXTRF))
+    return WATCHDOG_RESET_EXTERNAL;
+  if (_resetFlags & (1 << PORF))
+    return WATCHDOG_RESET_POWER_ON;
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+void WatchdogAVR::_setWDT(int wdto, uint8_t mode) {
+  // Build watchdog prescaler register value before timing critical code.
+  uint8_t wdtcr = mode | ((wdto & 0x08 ? 1 : 0) << WDP3) |
+                  ((wdto & 0x04 ? 1 : 0) << WDP2) |
+                  ((wdto & 0x02 ? 1 : 0) << WDP1) |
+                  ((wdto & 0x01 ? 1 : 0) << WDP0);
+
+  // The next section is timing critical so interrupts are disabled.
+  uint8_t sreg = SREG;
+  cli();
+  wdt_reset();
+  // Change the watchdog prescaler and mode.  This is a timing critical
+  // section of code that must happen in 4 cycles.
+  _WD_CONTROL_REG |=
+      (1 << WDCE) | (1 << WDE); // Set WDCE and WDE to enable changes.
+  _WD_CONTROL_REG = wdtcr;      // Set the prescaler and mode bits.
+  // Critical section finished, restore interrupts.
+  SREG = sreg;
+}
+
 void WatchdogAVR::_setPeriod(int maxMS, int &wdto, int &actualMS) {
   // Note the order of these if statements from highest to lowest  is
   // important so that control flow cascades down to the right value based
@@ -1,9 +1,22 @@
 #ifndef WATCHDOGAVR_H
 #define WATCHDOGAVR_H
 
-class WatchdogAVR {
+#include <stdint.h>
+
+#include "WatchdogBase.h"
+
+class WatchdogAVR : public WatchdogBase<WatchdogAVR> {
 public:
-  WatchdogAVR() : _wdto(-1) {}
+  WatchdogAVR() : _wdto(-1), _periodMS(0) {}
+
+  // Capabilities, for generic code to branch on at compile time (see
+  // WatchdogBase.h).
+  static constexpr bool canDisable = true;
+  static constexpr int32_t minPeriod = 15;
+  static constexpr int32_t maxPeriod = 8000;
+  static constexpr int32_t periodGranularity = 0;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
 
   // Enable the watchdog timer to reset the machine after a period of time
   // without any calls to reset().  The passed in period (in milliseconds) is
@@ -17,6 +30,32 @@ public:
   // Reset or 'kick' the watchdog timer to prevent a reset of the device.
   void reset();
 
+  // Current timeout in milliseconds (extended or not), 0 when off.
+  int period() { return _periodMS; }
+
+  // Two-stage escalation: the first timeout calls 'callback' (from the
+  // watchdog interrupt, so keep it short) to try and recover, e.g. by
+  // resetting a stuck peripheral, and only a second timeout in a row
+  // resets the device.  Pass NULL to go back to resetting straight away.
+  // Like setCapture(), this needs interrupts enabled at the deadline.
+  void setRecoveryCallback(void (*callback)(void));
+
+  // Have a missed deadline run the watchdog interrupt first, which notes
+  // the address the code was stuck at (see lastReset()) and then resets.
+  // The hardware only resets once that interrupt ran, so code stuck with
+  // interrupts off is never reset: off by default.
+  void setCapture(bool on);
+
+  // Change the timeout of the running watchdog (and kick it), up to 8
+  // seconds, for instance ahead of a long flash write.  Returns the
+  // previous timeout (0 if the watchdog is off, and then nothing changes)
+  // to hand back to restore() afterwards.  See WatchdogExtend for a guard
+  // that does both.
+  int extend(int maxPeriodMS);
+
+  // Go back to the timeout extend() returned, kicking the watchdog.
+  void restore(int prev);
+
   // Completely disable the watchdog timer.
   void disable();
 
@@ -25,10 +64,19 @@ public:
   // just a suggestion and a lower value might be picked if the hardware does
   // not support the exact desired value
   //
+  // On native USB chips (32u4) connected to a host, this is idle sleep,
+  // which keeps USB (and millis()) running, and so is it while
+  // sleepUntil() waits on an edge, which only a running I/O clock sees.
+  // Otherwise it is power-down, and USB is switched off meanwhile then
+  // attached again on wake.
+  //
   // The actual period (in milliseconds) that the hardware was asleep will be
   // returned.
   int sleep(int maxPeriodMS = 0);
 
+  // Find out the cause of the last reset.
+  WatchdogResetCause resetReason();
+
 private:
   // Pick the closest (but not higher) watchdog timer value from the provided
   // maximum period.  Sets wdto to the chosen period value suitable for
@@ -36,10 +84,19 @@ private:
   // milliseconds.  A max value of 0 will pick the longest value possible.
   void _setPeriod(int maxMS, int &wdto, int &actualMS);
 
+  // WDTCSR mode bits for the running watchdog, interrupt armed or not.
+  uint8_t _runMode();
+
+  // Program the watchdog with a WDTO_* period and WDE/WDIE mode bits.
+  void _setWDT(int wdto, uint8_t mode);
+
   // Keep the last selected watchdog timer period so that the watchdog can be
   // re-enabled at that rate after sleep.  A value of -1 means no watchdog
   // timer was enabled.
   int _wdto;
+
+  // Same, in milliseconds (0 when off).
+  int _periodMS;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,236 @@
+/*!
+ * @file WatchdogBase.h
+ *
+ * Common interface of the watchdog backends: the parts that are the same
+ * on every platform, and the compile-time capability traits each backend
+ * has to declare.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGBASE_H_
+#define WATCHDOGBASE_H_
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <time.h>
+#endif
+
+#include "WatchdogCrumbs.h"
+#include "WatchdogEnergy.h"
+#include "WatchdogPersist.h"
+#include "WatchdogTrace.h"
+#include "WatchdogWake.h"
+
+/**************************************************************************/
+/*!
+    @brief  Milliseconds since boot, millis() on Arduino.
+    @return The time in milliseconds, wrapping around like millis().
+*/
+/**************************************************************************/
+static inline uint32_t watchdog_millis() {
+#ifdef ARDUINO
+  return millis();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Base of every watchdog backend (CRTP: Derived is the backend
+            itself, so there are no virtual calls and nothing the sketch
+            doesn't use ends up in the binary).
+
+            A backend provides enable(), reset(), disable(), sleep(),
+            extend(), restore(), resetReason() and period(), plus these
+            capability traits for generic code to branch on at compile
+            time (with C++17, `if constexpr (WatchdogType::canDisable)`;
+            a plain `if` on them is folded away by the optimizer just the
+            same):
+
+            - `static constexpr bool canDisable`: disable() works (it is a
+              compile error otherwise).
+            - `static constexpr int32_t minPeriod`, `maxPeriod`: shortest
+              and longest timeouts enable() can program, in milliseconds.
+            - `static constexpr int32_t periodGranularity`: resolution of
+              the timeout in milliseconds, 0 if it only comes in power of
+              two steps.
+            - `static constexpr bool supportsSleep`: sleep() actually puts
+              the chip in a low power mode.
+            - `static constexpr bool stateSurvivesWake`: restoreState()
+              also hands the state back after waking from deep sleep.
+*/
+/**************************************************************************/
+template <class Derived> class WatchdogBase {
+public:
+  /*!
+      @brief  Leave a breadcrumb in memory that survives a reset, so that
+              after a watchdog reset lastReset() can tell which phase the
+              sketch was in.
+      @param  marker
+              Phase marker, 1 to 255.
+  */
+  void crumb(uint8_t marker) { WatchdogCrumbs::stamp(marker); }
+
+  /*!
+      @brief  Decodes the cause of the last reset and collects the
+              breadcrumbs left before it, along with the address the
+              watchdog interrupted where the hardware has an early warning.
+      @param  info
+              Filled in with the report.
+  */
+  void lastReset(WatchdogResetInfo &info) {
+    info.cause = self().resetReason();
+    WatchdogCrumbs::report(info);
+  }
+
+  /*!
+      @brief  Keep a copy of application state (calibration,
+              configuration...) in memory that survives a reset.
+      @param  state
+              State to save.
+      @param  len
+              Size of the state, up to WATCHDOG_STATE_SIZE bytes.
+      @return True on success, false if the state is too large.
+  */
+  bool saveState(const void *state, uint16_t len) {
+    return WatchdogPersist::save(state, len);
+  }
+
+  /*!
+      @brief  After a watchdog reset (or a wake from deep sleep, where
+              stateSurvivesWake), copy the state saved before it back so
+              the sketch can skip its expensive initialization.
+      @param  state
+              Where to copy the state to.
+      @param  len
+              Size of the state, must match what was saved.
+      @return True if the state was restored, false after any other kind of
+              reset or if nothing valid of that size was saved.
+  */
+  bool restoreState(void *state, uint16_t len) {
+    WatchdogResetCause cause = self().resetReason();
+    return (cause == WATCHDOG_RESET_WATCHDOG ||
+            (Derived::stateSurvivesWake && cause == WATCHDOG_RESET_WAKE)) &&
+           WatchdogPersist::load(state, len);
+  }
+
+  /*!
+      @brief  Kicks the watchdog, but only if a quarter of its period (see
+              setKickDivisor()) went by since resetIfDue() last did, so hot
+              loops can call it unconditionally at next to no cost: a
+              millis() call and a compare, against a hardware kick that can
+              mean clock domain synchronization (SAMD) or masking
+              interrupts (Kinetis).
+  */
+  void resetIfDue() {
+    uint32_t now = watchdog_millis();
+    if (now - _lastKick < (uint32_t)self().period() / _kickDivisor ||
+        !self().kickAllowed(now))
+      return;
+    _lastKick = now;
+    self().reset();
+  }
+
+  /*!
+      @brief  Backend hook for resetIfDue(), which kicks only if this
+              agrees: a backend with a window mode holds kicks back until
+              the closed window is over.
+      @param  now
+              watchdog_millis() at the time of the kick.
+      @return True if the hardware takes a kick now.
+  */
+  bool kickAllowed(uint32_t now) {
+    (void)now;
+    return true;
+  }
+
+  /*!
+      @brief  Makes resetIfDue() kick every period / divisor instead.
+      @param  divisor
+              Fraction of the period between kicks, 4 by default.
+  */
+  void setKickDivisor(uint8_t divisor) {
+    _kickDivisor = divisor ? divisor : 1;
+  }
+
+  /*!
+      @brief  Sleeps like sleep(), until one of the pins fires or the
+              timeout runs out, whichever comes first, and tells which.
+              The pins get interrupts attached like attachInterrupt() does
+              (so they have to be interrupt capable) for the duration of the
+              call only.
+      @param  sources
+              Pins to wake on, and on what, at most WATCHDOG_WAKE_SOURCES.
+      @param  count
+              Number of pins.
+      @param  maxPeriodMS
+              Timeout in milliseconds, rounded up to what sleep() can do, or
+              0 to wait for a pin only.
+      @return Index in sources of the pin that woke the chip up,
+              WATCHDOG_WAKE_TIMEOUT if the timeout ran out first, or
+              WATCHDOG_WAKE_OTHER if the chip couldn't sleep.
+  */
+  int sleepUntil(const WatchdogWakeSource *sources, uint8_t count,
+                 int maxPeriodMS = 0) {
+    int result = WATCHDOG_WAKE_TIMEOUT;
+    int slept = 0;
+    WatchdogWake::attach(sources, count);
+    while (!WatchdogWake::pending() && (!maxPeriodMS || slept < maxPeriodMS)) {
+      // Without a timeout, sleep in 8 s steps (which every backend can do).
+      int ms = self().sleep(maxPeriodMS ? maxPeriodMS - slept : 8000);
+      if (ms <= 0) {
+        result = WATCHDOG_WAKE_OTHER;
+        break;
+      }
+      slept += ms;
+    }
+    int fired = WatchdogWake::detach();
+    return fired >= 0 ? fired : result;
+  }
+
+  /*!
+      @brief  Reports how the time since boot split between awake and each
+              sleep mode, how often sleep() woke up (and how often before
+              its time), and the charge that adds up to with setCurrents().
+      @param  stats
+              Filled in with the counters.
+  */
+  void energy(WatchdogEnergyStats &stats) { WatchdogEnergy::stats(stats); }
+
+  /*!
+      @brief  Tells energy() what the board draws awake and in each sleep
+              mode, to estimate the charge drawn from the battery.
+      @param  table
+              Currents in microamps, from the datasheet or measured once.
+  */
+  void setCurrents(const WatchdogCurrentTable &table) {
+    WatchdogEnergy::setCurrents(table);
+  }
+
+  /*!
+      @brief  Starts the energy() counters over from now.
+  */
+  void clearEnergy() { WatchdogEnergy::clear(); }
+
+protected:
+  WatchdogBase() : _lastKick(0), _kickDivisor(4) {}
+
+private:
+  Derived &self() { return static_cast<Derived &>(*this); }
+
+  uint32_t _lastKick;
+  uint8_t _kickDivisor;
+};
+
+#endif // WATCHDOGBASE_H_
@@ -0,0 +1,43 @@
+#include "WatchdogCrumbs.h"
+#include <string.h>
+
+WATCHDOG_NOINIT WatchdogCrumbLog WatchdogCrumbs::_log;
+
+// Copy of the ring as it was found at boot, before this run starts
+// stamping over it.
+static WatchdogCrumbLog _previous;
+
+// Runs once before setup(): keep what the last run left behind and start a
+// fresh ring.  RAM is garbage after a power-on reset, hence the magic.
+static struct WatchdogCrumbsBoot {
+  WatchdogCrumbsBoot() {
+    if (WatchdogCrumbs::_log.magic == WATCHDOG_CRUMBS_MAGIC)
+      _previous = WatchdogCrumbs::_log;
+    memset(&WatchdogCrumbs::_log, 0, sizeof(WatchdogCrumbs::_log));
+    WatchdogCrumbs::_log.magic = WATCHDOG_CRUMBS_MAGIC;
+  }
+} _boot;
+
+/**************************************************************************/
+/*!
+    @brief  Fill in the breadcrumb part of a reset report (everything but
+            the cause, which is up to the backend and must be set first).
+    @param  info
+            Report to fill in.
+*/
+/**************************************************************************/
+void WatchdogCrumbs::report(WatchdogResetInfo &info) {
+  // The log survives other resets too, a capture is only news after the
+  // watchdog bit.
+  info.captured = _previous.captured == WATCHDOG_CRUMBS_MAGIC &&
+                  info.cause == WATCHDOG_RESET_WATCHDOG;
+  info.pc = info.captured ? _previous.pc : 0;
+  info.count = 0;
+  // Oldest entry is the one the head would overwrite next.
+  for (uint8_t i = 0; i < WATCHDOG_CRUMBS; i++) {
+    uint8_t marker =
+        _previous.crumbs[(uint8_t)(_previous.head + i) & (WATCHDOG_CRUMBS - 1)];
+    if (marker)
+      info.crumbs[info.count++] = marker;
+  }
+}
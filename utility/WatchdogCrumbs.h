@@ -0,0 +1,131 @@
+/*!
+ * @file WatchdogCrumbs.h
+ *
+ * Crash breadcrumbs kept in RAM that survives a reset, plus the decoded
+ * reset cause shared by all of the watchdog backends.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGCRUMBS_H_
+#define WATCHDOGCRUMBS_H_
+
+#include <stdint.h>
+
+// Storage that is not cleared by the C runtime on boot, so it still holds
+// whatever was written before a watchdog (or any other non power-on) reset.
+#if defined(ARDUINO_ARCH_ESP32)
+#include "esp_attr.h"
+#define WATCHDOG_NOINIT RTC_NOINIT_ATTR
+#elif defined(ARDUINO_ARCH_RP2040)
+#define WATCHDOG_NOINIT __attribute__((section(".uninitialized_data")))
+#elif defined(ARDUINO_ARCH_ESP8266)
+// RAM is reloaded by the ROM bootloader on every reset.
+#define WATCHDOG_NOINIT
+#elif defined(__linux__)
+// A restarted service is a fresh process, nothing carries over.
+#define WATCHDOG_NOINIT
+#else
+#define WATCHDOG_NOINIT __attribute__((section(".noinit")))
+#endif
+
+#if defined(__arm__)
+// Define a naked Cortex-M interrupt handler that passes the exception frame
+// of the interrupted code (r0-r3, r12, lr, pc, xpsr) on to body(frame), in
+// order to find the interrupted pc before the compiler pushes anything.
+#define WATCHDOG_CRUMBS_NAKED_ISR(handler, body)                               \
+  extern "C" __attribute__((used)) void body(uint32_t *frame);                 \
+  extern "C" void handler(void) __attribute__((naked));                        \
+  extern "C" void handler(void) {                                              \
+    __asm__ __volatile__("movs r0, #4      \n"                                 \
+                         "mov r1, lr       \n"                                 \
+                         "tst r0, r1       \n"                                 \
+                         "beq 1f           \n"                                 \
+                         "mrs r0, psp      \n"                                 \
+                         "b 2f             \n"                                 \
+                         "1: mrs r0, msp   \n"                                 \
+                         "2: ldr r1, =" #body "\n"                             \
+                         "bx r1            \n"                                 \
+                         ".ltorg           \n");                               \
+  }
+#endif
+
+#ifndef WATCHDOG_CRUMBS
+/** Number of breadcrumbs kept, must be a power of two. */
+#define WATCHDOG_CRUMBS 8
+#endif
+
+/** Decoded cause of the last reset, common to every platform. */
+typedef enum {
+  WATCHDOG_RESET_UNKNOWN = 0, ///< Platform can't tell (or didn't say)
+  WATCHDOG_RESET_POWER_ON,    ///< Power-on reset
+  WATCHDOG_RESET_EXTERNAL,    ///< Reset pin
+  WATCHDOG_RESET_BROWNOUT,    ///< Supply voltage dropped too low
+  WATCHDOG_RESET_WATCHDOG,    ///< Watchdog timeout
+  WATCHDOG_RESET_SOFTWARE,    ///< Requested by software (or a debugger)
+  WATCHDOG_RESET_FAULT,       ///< CPU lockup, exception or panic
+  WATCHDOG_RESET_WAKE,        ///< Wake from deep sleep / system off
+} WatchdogResetCause;
+
+/** What happened before the last reset. */
+typedef struct {
+  WatchdogResetCause cause; ///< Decoded reset cause
+  bool captured; ///< Early warning stage ran before the reset
+  uint32_t pc;   ///< Address interrupted by the early warning, 0 if unknown
+  uint8_t count; ///< Number of valid entries in crumbs[]
+  uint8_t crumbs[WATCHDOG_CRUMBS]; ///< Markers, oldest first
+} WatchdogResetInfo;
+
+/** Ring of breadcrumbs as laid out in retained RAM. */
+typedef struct {
+  uint32_t magic;    ///< WATCHDOG_CRUMBS_MAGIC once initialized
+  uint32_t captured; ///< WATCHDOG_CRUMBS_MAGIC if the early warning ran
+  uint32_t pc;       ///< Address interrupted by the early warning
+  uint8_t head;      ///< Free running index of the next crumb
+  uint8_t crumbs[WATCHDOG_CRUMBS]; ///< Ring of markers, 0 = empty
+} WatchdogCrumbLog;
+
+/** Marks a WatchdogCrumbLog (and its capture) as valid. */
+#define WATCHDOG_CRUMBS_MAGIC 0x57444F47UL
+
+/**************************************************************************/
+/*!
+    @brief  Breadcrumb ring shared by all backends.  Stamping a crumb is a
+            couple of stores, cheap enough to sprinkle through a main loop;
+            the backend's watchdog interrupt (where the hardware has one)
+            records the interrupted address right before the reset.
+*/
+/**************************************************************************/
+class WatchdogCrumbs {
+public:
+  /*!
+      @brief  Record a phase marker.
+      @param  marker
+              Any value from 1 to 255, 0 is reserved for 'empty'.
+  */
+  static void stamp(uint8_t marker) {
+    uint8_t i = _log.head;
+    _log.crumbs[i & (WATCHDOG_CRUMBS - 1)] = marker;
+    _log.head = i + 1;
+  }
+
+  /*!
+      @brief  Called from a watchdog interrupt right before the reset.
+      @param  pc
+              Address the interrupt returns to.
+  */
+  static void capture(uint32_t pc) {
+    _log.pc = pc;
+    _log.captured = WATCHDOG_CRUMBS_MAGIC;
+  }
+
+  static void report(WatchdogResetInfo &info);
+
+  static WatchdogCrumbLog _log; ///< Live ring, in retained RAM
+};
+
+#endif // WATCHDOGCRUMBS_H_
@@ -1,6 +1,34 @@
 #if defined(ARDUINO_ARCH_ESP32)
 
 #include "WatchdogESP32.h"
+#include "driver/gpio.h"
+#include "esp32-hal-cpu.h"
+#include "esp_timer.h"
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+// IDF V4.x has one (identical) power management config struct per chip
+#if defined(CONFIG_IDF_TARGET_ESP32S2)
+typedef esp_pm_config_esp32s2_t esp_pm_config_t;
+#elif defined(CONFIG_IDF_TARGET_ESP32S3)
+typedef esp_pm_config_esp32s3_t esp_pm_config_t;
+#elif defined(CONFIG_IDF_TARGET_ESP32C3)
+typedef esp_pm_config_esp32c3_t esp_pm_config_t;
+#else
+typedef esp_pm_config_esp32_t esp_pm_config_t;
+#endif
+#endif
+
+// Period the TWDT actually runs for when asked for maxPeriodMS: before
+// IDF 5.1.1 it counts whole seconds, rounded up so that it never bites early
+// (and a sub-second period doesn't turn into 0).
+static int _twdtPeriod(int maxPeriodMS) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 1)
+  return maxPeriodMS;
+#else
+  int seconds = (maxPeriodMS + 999) / 1000;
+  return (seconds < 1 ? 1 : seconds) * 1000;
+#endif
+}
 
 /**************************************************************************/
 /*!
@@ -16,25 +44,8 @@ int WatchdogESP32::enable(int maxPeriodMS) {
   if (maxPeriodMS < 0)
     return 0;
 
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 1)
-// Initialize the wdt configuration for ESP-IDF v5.x and above
-#include "soc/soc_caps.h"
-  esp_task_wdt_config_t wdt_config = {
-      .timeout_ms = (uint32_t)maxPeriodMS,
-      .idle_core_mask = (1 << SOC_CPU_CORES_NUM) - 1, // Bitmask of all cores
-      .trigger_panic = true,
-  };
-  esp_err_t err = esp_task_wdt_init(&wdt_config);
-  // Reconfigure in case TWDT was already initialized
-  if (err == ESP_ERR_INVALID_STATE)
-    err = esp_task_wdt_reconfigure(&wdt_config);
-#else
-  // IDF V4.x and below expect TWDT in seconds
-  uint32_t maxPeriod = maxPeriodMS / 1000;
-  // Enable the TWDT and execute the esp32 panic handler when TWDT times out
-  esp_err_t err = esp_task_wdt_init(maxPeriod, true);
-#endif
-
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
+  esp_err_t err = _configure(maxPeriodMS);
   if (err != ESP_OK)
     return 0; // Failed to initialize TWDT
 
@@ -43,8 +54,45 @@ int WatchdogESP32::enable(int maxPeriodMS) {
   if (err != ESP_OK)
     return 0; // Failed to subscribe to TWDT, may be already subscribed
 
-  _wdto = maxPeriodMS;
-  return maxPeriodMS;
+  _wdto = _twdtPeriod(maxPeriodMS);
+  _escalated = false;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
+  return _wdto;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Changes the TWDT timeout (and kicks it on behalf of the current
+            task), for instance ahead of a long flash write.  See
+            WatchdogExtend for a guard that restores it afterwards.
+    @param    maxPeriodMS
+              New timeout, in milliseconds (whole seconds before ESP-IDF
+              5.1).
+    @return The previous timeout to hand back to restore(), 0 if the
+            watchdog is off (and then nothing changes).
+*/
+/**************************************************************************/
+int WatchdogESP32::extend(int maxPeriodMS) {
+  int prev = _wdto > 0 ? _wdto : 0;
+  if (prev && maxPeriodMS > 0 && _configure(maxPeriodMS) == ESP_OK) {
+    _wdto = _twdtPeriod(maxPeriodMS);
+    esp_task_wdt_reset();
+  }
+  return prev;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Goes back to the timeout extend() returned, kicking the TWDT on
+            behalf of the current task.
+    @param    prev
+              Value returned by extend().
+*/
+/**************************************************************************/
+void WatchdogESP32::restore(int prev) {
+  if (prev > 0 && _configure(prev) == ESP_OK)
+    _wdto = prev;
+  esp_task_wdt_reset();
 }
 
 /**************************************************************************/
@@ -56,8 +104,29 @@ int WatchdogESP32::enable(int maxPeriodMS) {
 void WatchdogESP32::reset() {
   // NOTE: This blindly resets the TWDT and does not return the esp_err.
   esp_task_wdt_reset();
+  _escalated = false;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sets up two-stage escalation: the first TWDT timeout calls the
+            callback (from the TWDT interrupt, so it must be short and
+            ISR-safe) to try and recover, and only a second timeout in a
+            row without a reset() in between resets the chip.  Takes
+            effect on the next enable().
+    @param    callback
+              Soft recovery function, NULL to go back to the panic handler
+              on the first timeout.
+*/
+/**************************************************************************/
+void WatchdogESP32::setRecoveryCallback(void (*callback)(void)) {
+  _recovery = callback;
 }
 
+void (*volatile WatchdogESP32::_recovery)(void) = NULL;
+volatile bool WatchdogESP32::_escalated = false;
+
 /**************************************************************************/
 /*!
     @brief  Unsubscribes the currently running task from the the TWDT,
@@ -72,6 +141,65 @@ void WatchdogESP32::disable() {
   _wdto = 0;             // Reset the timeout value
 }
 
+/**************************************************************************/
+/*!
+    @brief  Decodes the cause of the last reset.
+    @return The cause of the last reset.
+*/
+/**************************************************************************/
+WatchdogResetCause WatchdogESP32::resetReason() {
+  switch (esp_reset_reason()) {
+  case ESP_RST_TASK_WDT:
+  case ESP_RST_INT_WDT:
+  case ESP_RST_WDT:
+    return WATCHDOG_RESET_WATCHDOG;
+  case ESP_RST_PANIC:
+    return WATCHDOG_RESET_FAULT;
+  case ESP_RST_SW:
+    return WATCHDOG_RESET_SOFTWARE;
+  case ESP_RST_BROWNOUT:
+    return WATCHDOG_RESET_BROWNOUT;
+  case ESP_RST_DEEPSLEEP:
+    return WATCHDOG_RESET_WAKE;
+  case ESP_RST_EXT:
+    return WATCHDOG_RESET_EXTERNAL;
+  case ESP_RST_POWERON:
+    return WATCHDOG_RESET_POWER_ON;
+  default:
+    return WATCHDOG_RESET_UNKNOWN;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Called by ESP-IDF from the TWDT interrupt when a subscribed task
+            missed its deadline, right before the panic handler resets the
+            chip.  The interrupted task isn't known here, so only the fact
+            that it happened is noted next to the breadcrumbs.
+*/
+/**************************************************************************/
+extern "C" void esp_task_wdt_isr_user_handler(void) {
+  WatchdogCrumbs::capture(0);
+  WatchdogESP32::_timeout();
+}
+
+/**************************************************************************/
+/*!
+    @brief  TWDT timeout with the panic handler turned off, i.e. with a
+            recovery callback: try to recover the first time around, give
+            up (through the panic handler) the second time.
+*/
+/**************************************************************************/
+void WatchdogESP32::_timeout() {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ISR);
+  if (!_recovery)
+    return; // the panic handler takes it from here
+  if (_escalated)
+    esp_system_abort("task watchdog: recovery failed");
+  _escalated = true;
+  _recovery();
+}
+
 /**************************************************************************/
 /*!
     @brief  Configures the ESP32 to enter a low-power sleep mode for a
@@ -94,11 +222,270 @@ int WatchdogESP32::sleep(int maxPeriodMS) {
     return 0; // sleepTime is out of range
   }
   // Enter light sleep with the timer wakeup option configured
+  WatchdogEnergy::sleepBegin();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
   err = esp_light_sleep_start();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
   if (err != ESP_OK) {
     return 0; // ESP_ERR_INVALID_STATE if WiFi or BT is not stopped
   }
+  WatchdogEnergy::sleepEnd(
+      WATCHDOG_SLEEP_STOP, maxPeriodMS,
+      esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
   return maxPeriodMS;
 }
 
+/**************************************************************************/
+/*!
+    @brief  Light sleep until one of the pins fires or the timeout runs
+            out, whichever comes first.  GPIO wake-up only knows levels, so
+            RISING and HIGH wake on a high level, FALLING and LOW on a low
+            one, and CHANGE on the opposite of the pin's level when going to
+            sleep.  This replaces any interrupt attached to the pins.  See
+            deepSleep() and wakeOnPin() to wake up from deep sleep instead.
+    @param    sources
+              Pins to wake on, and on what, at most WATCHDOG_WAKE_SOURCES.
+    @param    count
+              Number of pins.
+    @param    maxPeriodMS
+              Timeout in milliseconds, 0 to wait for a pin only.
+    @return Index in sources of the pin that woke the ESP32 up,
+            WATCHDOG_WAKE_TIMEOUT if the timeout ran out first, or
+            WATCHDOG_WAKE_OTHER if it woke up for another reason (or
+            couldn't sleep, with WiFi or BT on).
+*/
+/**************************************************************************/
+int WatchdogESP32::sleepUntil(const WatchdogWakeSource *sources,
+                              uint8_t count, int maxPeriodMS) {
+  if (count > WATCHDOG_WAKE_SOURCES)
+    count = WATCHDOG_WAKE_SOURCES;
+  bool high[WATCHDOG_WAKE_SOURCES];
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t mode = sources[i].mode;
+    if (mode == CHANGE)
+      high[i] = digitalRead(sources[i].pin) == LOW;
+    else
+      high[i] = mode == HIGH || mode == RISING || mode == ONHIGH;
+    gpio_wakeup_enable((gpio_num_t)sources[i].pin,
+                       high[i] ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  // A timer wake-up left armed elsewhere would end a pin-only wait.
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  if (maxPeriodMS > 0)
+    esp_sleep_enable_timer_wakeup((uint64_t)maxPeriodMS * 1000);
+
+  int result = WATCHDOG_WAKE_OTHER;
+  WatchdogEnergy::sleepBegin();
+  int64_t start = esp_timer_get_time();
+  if (esp_light_sleep_start() == ESP_OK) {
+    int slept = (esp_timer_get_time() - start) / 1000;
+    WatchdogEnergy::sleepEnd(
+        WATCHDOG_SLEEP_STOP, slept,
+        esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER);
+    switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_TIMER:
+      result = WATCHDOG_WAKE_TIMEOUT;
+      break;
+    case ESP_SLEEP_WAKEUP_GPIO:
+      // The first pin still at its wake-up level is the one that fired
+      for (uint8_t i = 0; i < count; i++) {
+        if ((digitalRead(sources[i].pin) == HIGH) == high[i]) {
+          result = i;
+          break;
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+    gpio_wakeup_disable((gpio_num_t)sources[i].pin);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  return result;
+}
+
+// (Re)configure the TWDT, whether it's running or not.
+esp_err_t WatchdogESP32::_configure(int maxPeriodMS) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 1)
+  // Initialize the wdt configuration for ESP-IDF v5.x and above
+  esp_task_wdt_config_t wdt_config = {
+      .timeout_ms = (uint32_t)maxPeriodMS,
+      .idle_core_mask = (1 << SOC_CPU_CORES_NUM) - 1, // Bitmask of all cores
+      .trigger_panic = (_recovery == NULL),
+  };
+  esp_err_t err = esp_task_wdt_init(&wdt_config);
+  // Reconfigure in case TWDT was already initialized
+  if (err == ESP_ERR_INVALID_STATE)
+    err = esp_task_wdt_reconfigure(&wdt_config);
+  return err;
+#else
+  // IDF V4.x and below expect TWDT in seconds, and update the timeout if it
+  // was already initialized.
+  uint32_t maxPeriod = _twdtPeriod(maxPeriodMS) / 1000;
+  // Enable the TWDT and execute the esp32 panic handler when TWDT times out
+  // (unless there is a recovery callback, see esp_task_wdt_isr_user_handler)
+  return esp_task_wdt_init(maxPeriod, _recovery == NULL);
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Hands idle time over to the ESP-IDF power management: whenever
+            no task is ready to run, the CPU clock drops to minMHz and the
+            chip goes into light sleep on its own until the next timer,
+            FreeRTOS tick or WiFi/BT beacon is due.  Unlike sleep(), this
+            keeps the radios connected, and the TWDT keeps watching the
+            subscribed tasks since it times task run time, not wall-clock
+            idle time.
+            Needs an Arduino core built with CONFIG_PM_ENABLE and
+            CONFIG_FREERTOS_USE_TICKLESS_IDLE.
+    @param    maxMHz
+              CPU frequency while busy, 0 for the current one.
+    @param    minMHz
+              CPU frequency while idle, 0 for the crystal frequency.
+    @return True on success, false if power management or automatic light
+            sleep isn't supported by the core, or the frequencies aren't.
+*/
+/**************************************************************************/
+bool WatchdogESP32::enableAutoSleep(int maxMHz, int minMHz) {
+  if (maxMHz <= 0)
+    maxMHz = getCpuFrequencyMhz();
+  if (minMHz <= 0)
+    minMHz = getXtalFrequencyMhz();
+  return _configurePM(maxMHz, minMHz, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stops automatic light sleep and frequency scaling, the CPU runs
+            at full speed again.
+    @return True on success, false if power management isn't supported.
+*/
+/**************************************************************************/
+bool WatchdogESP32::disableAutoSleep() {
+  int mhz = getCpuFrequencyMhz();
+  return _configurePM(mhz, mhz, false);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Keeps the chip out of automatic light sleep, for instance while
+            a peripheral that stops in light sleep (UART, PWM...) is busy.
+            Calls nest: sleep is only allowed again once each stayAwake()
+            is matched by an allowSleep().
+    @return True on success, false if power management isn't supported.
+*/
+/**************************************************************************/
+bool WatchdogESP32::stayAwake() {
+  if (!_pmLock &&
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "SleepyDog", &_pmLock) !=
+          ESP_OK)
+    return false;
+  return esp_pm_lock_acquire(_pmLock) == ESP_OK;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Lets the chip go back to automatic light sleep, undoing one
+            stayAwake().
+*/
+/**************************************************************************/
+void WatchdogESP32::allowSleep() {
+  if (_pmLock)
+    esp_pm_lock_release(_pmLock);
+}
+
+bool WatchdogESP32::_configurePM(int maxMHz, int minMHz, bool lightSleep) {
+  esp_pm_config_t config = {
+      .max_freq_mhz = maxMHz,
+      .min_freq_mhz = minMHz,
+      .light_sleep_enable = lightSleep,
+  };
+  // ESP_ERR_NOT_SUPPORTED without CONFIG_PM_ENABLE, or when light sleep is
+  // asked for without tickless idle
+  return esp_pm_configure(&config) == ESP_OK;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Puts the ESP32 in deep sleep, the lowest power mode: only the
+            RTC domain stays up and waking up goes through a reset, so this
+            only returns if it can't keep the state.  Besides the timer,
+            the chip wakes on any pin set up with wakeOnPin() /
+            wakeOnPins(); wakeCause() tells which once setup() runs again.
+            Works with WiFi/BT up, they are shut down on the way.
+    @param    maxPeriodMS
+              Time to sleep the ESP32, in millis.  0 sleeps until a wake-up
+              pin fires.
+    @param    state
+              Optional application state to keep in RTC memory, handed
+              back by restoreState() after waking up.
+    @param    len
+              Size of the state, up to WATCHDOG_STATE_SIZE bytes.
+    @return False, without sleeping, if the state is too large to keep.
+*/
+/**************************************************************************/
+bool WatchdogESP32::deepSleep(int maxPeriodMS, const void *state,
+                              uint16_t len) {
+  if (state && !WatchdogPersist::save(state, len))
+    return false;
+  // Timer wake-up from an earlier sleep() would still be armed otherwise.
+  if (maxPeriodMS > 0)
+    esp_sleep_enable_timer_wakeup((uint64_t)maxPeriodMS * 1000);
+  else
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  esp_deep_sleep_start();
+}
+
+#if SOC_PM_SUPPORT_EXT0_WAKEUP
+/**************************************************************************/
+/*!
+    @brief  Wakes the ESP32 from deepSleep() when a pin goes to the given
+            level (EXT0).  Only one pin can be set up this way, and it has
+            to be an RTC GPIO.
+    @param    pin
+              RTC GPIO to watch.
+    @param    high
+              Wake when the pin is high (true) or low (false).
+    @return True on success, false if the pin is not an RTC GPIO.
+*/
+/**************************************************************************/
+bool WatchdogESP32::wakeOnPin(int pin, bool high) {
+  return esp_sleep_enable_ext0_wakeup((gpio_num_t)pin, high ? 1 : 0) ==
+         ESP_OK;
+}
+#endif
+
+#if SOC_PM_SUPPORT_EXT1_WAKEUP
+/**************************************************************************/
+/*!
+    @brief  Wakes the ESP32 from deepSleep() on a set of RTC GPIOs (EXT1):
+            when any of them goes high, or when they are all low (any of
+            them low on chips other than the original ESP32, with ESP-IDF
+            5 or newer).
+    @param    pinMask
+              Bit mask of the RTC GPIOs to watch, (1ULL << pin).
+    @param    high
+              Wake on a high (true) or low (false) level.
+    @return True on success, false if a pin is not an RTC GPIO.
+*/
+/**************************************************************************/
+bool WatchdogESP32::wakeOnPins(uint64_t pinMask, bool high) {
+#if defined(CONFIG_IDF_TARGET_ESP32) ||                                        \
+    ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+  esp_sleep_ext1_wakeup_mode_t mode =
+      high ? ESP_EXT1_WAKEUP_ANY_HIGH : ESP_EXT1_WAKEUP_ALL_LOW;
+#else
+  esp_sleep_ext1_wakeup_mode_t mode =
+      high ? ESP_EXT1_WAKEUP_ANY_HIGH : ESP_EXT1_WAKEUP_ANY_LOW;
+#endif
+  return esp_sleep_enable_ext1_wakeup(pinMask, mode) == ESP_OK;
+}
+#endif
+
 #endif // ARDUINO_ARCH_ESP32
\ No newline at end of file
@@ -14,8 +14,13 @@
  */
 #ifndef WATCHDOGESP32_H_
 #define WATCHDOGESP32_H_
+#include "esp_pm.h"
 #include "esp_sleep.h"
+#include "esp_system.h"
 #include "esp_task_wdt.h"
+#include "soc/soc_caps.h"
+
+#include "WatchdogBase.h"
 
 /**************************************************************************/
 /*!
@@ -23,16 +28,76 @@
             WDT and low-power sleep functions.
 */
 /**************************************************************************/
-class WatchdogESP32 {
+class WatchdogESP32 : public WatchdogBase<WatchdogESP32> {
 public:
-  WatchdogESP32() : _wdto(-1){};
+  WatchdogESP32() : _wdto(-1), _pmLock(NULL){};
+
+  /// Capabilities, for generic code to branch on at compile time (see
+  /// WatchdogBase.h).
+  static constexpr bool canDisable = true;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 1)
+  static constexpr int32_t minPeriod = 1;
+  static constexpr int32_t periodGranularity = 1;
+#else
+  static constexpr int32_t minPeriod = 1000; // Whole seconds before 5.1.1
+  static constexpr int32_t periodGranularity = 1000;
+#endif
+  static constexpr int32_t maxPeriod = 2147483647;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = true;
+
   int enable(int maxPeriodMS = 0);
   void reset();
+  /*!
+      @brief  Tells the current timeout (extended or not).
+      @return The timeout in milliseconds, 0 when off.
+  */
+  int period() { return _wdto > 0 ? _wdto : 0; }
+  int extend(int maxPeriodMS);
+  void restore(int prev);
+  void setRecoveryCallback(void (*callback)(void));
   void disable();
   int sleep(int maxPeriodMS = 0);
+  int sleepUntil(const WatchdogWakeSource *sources, uint8_t count,
+                 int maxPeriodMS = 0);
+  bool enableAutoSleep(int maxMHz = 0, int minMHz = 0);
+  bool disableAutoSleep();
+  bool stayAwake();
+  void allowSleep();
+  bool deepSleep(int maxPeriodMS = 0, const void *state = NULL,
+                 uint16_t len = 0);
+#if SOC_PM_SUPPORT_EXT0_WAKEUP
+  bool wakeOnPin(int pin, bool high);
+#endif
+#if SOC_PM_SUPPORT_EXT1_WAKEUP
+  bool wakeOnPins(uint64_t pinMask, bool high);
+#endif
+  /*!
+      @brief  Tells what woke the ESP32 from (deep) sleep.
+      @return ESP_SLEEP_WAKEUP_TIMER, ESP_SLEEP_WAKEUP_EXT0,
+              ESP_SLEEP_WAKEUP_EXT1..., or ESP_SLEEP_WAKEUP_UNDEFINED after
+              any other reset.
+  */
+  esp_sleep_wakeup_cause_t wakeCause() { return esp_sleep_get_wakeup_cause(); }
+#if SOC_PM_SUPPORT_EXT1_WAKEUP
+  /*!
+      @brief  After an EXT1 wake-up, tells which of the pins woke the ESP32.
+      @return Bit mask of the pins, (1ULL << pin).
+  */
+  uint64_t wakePins() { return esp_sleep_get_ext1_wakeup_status(); }
+#endif
+  WatchdogResetCause resetReason();
+
+  static void _timeout();
 
 private:
+  esp_err_t _configure(int maxPeriodMS);
+  bool _configurePM(int maxMHz, int minMHz, bool lightSleep);
+
   int _wdto;
+  esp_pm_lock_handle_t _pmLock; // Held by stayAwake(), created on first use
+  static void (*volatile _recovery)(void);
+  static volatile bool _escalated;
 };
 
 #endif // WATCHDOGESP32_H
\ No newline at end of file
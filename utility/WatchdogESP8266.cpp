@@ -1,40 +1,203 @@
 #if defined(ARDUINO_ARCH_ESP8266)
 
 #include "WatchdogESP8266.h"
+#include <stddef.h>
+#include <string.h>
+#include <user_interface.h>
 
-/**********************************************************************************************/
+// Deep sleep checkpoint in RTC user memory, right after the warm restart
+// block kept by WatchdogPersist (which starts at block 32).
+#define WATCHDOG_CHECKPOINT_RTC_OFFSET                                         \
+  (32 + (sizeof(WatchdogPersistBlock) + 3) / 4)
+#define WATCHDOG_CHECKPOINT_MAGIC 0x57434B50UL
+
+typedef struct {
+  uint32_t magic;
+  uint16_t len;       // Number of valid bytes in data[]
+  uint16_t crc;       // CRC-16/CCITT of everything from channel on
+  uint8_t channel;    // WiFi channel, 0 if not connected at checkpoint time
+  uint8_t bssid[6];   // Access point the station was connected to
+  uint8_t reserved;
+  uint8_t data[(WATCHDOG_CHECKPOINT_SIZE + 3) & ~3];
+} WatchdogCheckpoint;
+
+static_assert(WATCHDOG_CHECKPOINT_RTC_OFFSET * 4 + sizeof(WatchdogCheckpoint) <=
+                  512,
+              "Checkpoint doesn't fit in RTC user memory");
+
+// CRC of the checkpoint from the WiFi data up to the end of the state.
+static uint16_t _checkpointCRC(const WatchdogCheckpoint &cp) {
+  return WatchdogPersist::crc16(&cp.channel, 8 + cp.len);
+}
+
+// Read the checkpoint back, if a deep sleep wake-up has a valid one.
+static bool _readCheckpoint(WatchdogCheckpoint &cp) {
+  if (ESP.getResetInfoPtr()->reason != REASON_DEEP_SLEEP_AWAKE)
+    return false;
+  if (!ESP.rtcUserMemoryRead(WATCHDOG_CHECKPOINT_RTC_OFFSET, (uint32_t *)&cp,
+                             sizeof(cp)))
+    return false;
+  return cp.magic == WATCHDOG_CHECKPOINT_MAGIC &&
+         cp.len <= WATCHDOG_CHECKPOINT_SIZE && cp.crc == _checkpointCRC(cp);
+}
+
+// Configurable software watchdog, layered on the timer0 (CCOMPARE0)
+// interrupt: the SDK's own software WDT is fixed at ~3.2 seconds, so it is
+// stopped and the interrupt feeds the hardware WDT behind it instead.  That
+// one only bites when interrupts are off for too long, the interrupt itself
+// resets the chip once nothing called reset() for the configured period.
+#define WATCHDOG_FEED_US 1000000UL // Longest gap between hardware WDT feeds
+
+// The interrupt can fire while the flash cache is off, so it sticks to
+// register writes (the hardware WDT feed register and RTC user memory, block
+// 64 of RTC memory on) and the ROM's reset.
+#define WATCHDOG_HW_WDT_FEED ESP8266_REG(0x914)
+#define WATCHDOG_HW_WDT_FEED_MAGIC 0x73
+#define WATCHDOG_RTC_USER_MEM(block) ESP8266_REG(0x1000 + (64 + (block)) * 4)
+extern "C" void software_reset(void);
+
+// RTC user memory block noting that the reset came from the timeout below;
+// the SDK only sees a hardware WDT reset.  Last block, clear of the persist
+// and checkpoint blocks.
+#define WATCHDOG_FIRED_RTC_OFFSET 127
+#define WATCHDOG_FIRED_MAGIC 0x57444649UL
+
+static volatile uint32_t _lastKickUS; // micros() of the last reset()
+static uint32_t _timeoutUS;           // 0 = software watchdog off
+static uint32_t _cyclesPerUS;
+static bool _fired; // Last reset came from the software watchdog
+
+// Pick up (and clear) the marker left by the timeout below, before setup().
+static struct WatchdogFiredBoot {
+  WatchdogFiredBoot() {
+    uint32_t marker;
+    if (ESP.rtcUserMemoryRead(WATCHDOG_FIRED_RTC_OFFSET, &marker,
+                              sizeof(marker)) &&
+        marker == WATCHDOG_FIRED_MAGIC) {
+      _fired = true;
+      marker = 0;
+      ESP.rtcUserMemoryWrite(WATCHDOG_FIRED_RTC_OFFSET, &marker,
+                             sizeof(marker));
+    }
+  }
+} _firedBoot;
+
+static void IRAM_ATTR _watchdogTick() {
+  uint32_t elapsed = micros() - _lastKickUS;
+  if (elapsed >= _timeoutUS) {
+    // Reset right away, with everything masked so that nothing (the SDK
+    // feeding the hardware WDT on a yield() included) gets in the way.
+    // Should the ROM reset ever return, the starved hardware WDT bites.
+    WATCHDOG_RTC_USER_MEM(WATCHDOG_FIRED_RTC_OFFSET) = WATCHDOG_FIRED_MAGIC;
+    xt_rsil(15);
+    software_reset();
+    for (;;)
+      ;
+  }
+  WATCHDOG_HW_WDT_FEED = WATCHDOG_HW_WDT_FEED_MAGIC;
+
+  // Come back at the deadline (a reset() in between only moves it later),
+  // or in time for the next SDK WDT feed, whichever is first.
+  uint32_t next = _timeoutUS - elapsed;
+  if (next > WATCHDOG_FEED_US)
+    next = WATCHDOG_FEED_US;
+  timer0_write(ESP.getCycleCount() + next * _cyclesPerUS);
+}
+
+/**************************************************************************/
 /*!
-    @brief  Initializes the ESP8266's software WDT
+    @brief  Initializes a software WDT with a configurable timeout in place
+            of the ESP8266's fixed ~3.2 second SDK software WDT, using the
+            timer0 interrupt (so timer0 is not available to the sketch).
     @param    maxPeriodMS
-              Timeout period of WDT in milliseconds
+              Timeout period of WDT in milliseconds, up to 30 minutes.  0
+              picks 8 seconds, like on AVR.
     @return The actual period (in milliseconds) before a watchdog timer
             reset is returned, 0 otherwise.
-    NOTE: Configuring the software WDT timeout maxPeriodMS value is NOT
-   IMPLEMENTED in the ESP8266 BSP [1]. Further, an investigation into the
-   default software WDT time yielded a fixed timeout period of 3.2 seconds [2].
-    [1] https://github.com/esp8266/Arduino/blob/master/cores/esp8266/Esp.h#L91
-    [2]https://sigmdel.ca/michel/program/esp8266/arduino/watchdogs_en.html#ESP8266_WDT_TIMEOUT
 */
-/**********************************************************************************************/
+/**************************************************************************/
 int WatchdogESP8266::enable(int maxPeriodMS) {
   if (maxPeriodMS < 0)
     return 0;
+  if (maxPeriodMS == 0)
+    maxPeriodMS = 8000;
+  if (maxPeriodMS > 1800000)
+    maxPeriodMS = 1800000;
 
-  // Enable the WDT
-  ESP.wdtEnable(0);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
+  // The SDK WDT would bite on long timeouts, the hardware WDT is fed from
+  // the timer0 interrupt from now on
+  ESP.wdtDisable();
+
+  _cyclesPerUS = ESP.getCpuFreqMHz();
+  _lastKickUS = micros();
+  _timeoutUS = (uint32_t)maxPeriodMS * 1000;
+  if (_wdto <= 0) {
+    noInterrupts();
+    timer0_isr_init();
+    timer0_attachInterrupt(_watchdogTick);
+    timer0_write(ESP.getCycleCount() + 1000 * _cyclesPerUS);
+    interrupts();
+  }
 
   _wdto = maxPeriodMS;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
   return maxPeriodMS;
 }
 
 /**************************************************************************/
 /*!
     @brief  Feeds the Watchdog timer.
-    NOTE: Calling yield() or delay() also feeds the hardware and software
-    watchdog timers.
+    NOTE: Calling yield() or delay() also feeds the SDK's hardware and
+    software watchdog timers, but not the configurable one on top.
+*/
+/**************************************************************************/
+void WatchdogESP8266::reset() {
+  _lastKickUS = micros();
+  ESP.wdtFeed();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Changes the timeout of the running watchdog (and kicks it), for
+            instance ahead of a long flash write.  It's a software timeout,
+            so this is just a couple of stores.  See WatchdogExtend for a
+            guard that restores it afterwards.
+    @param    maxPeriodMS
+              New timeout, in milliseconds, up to 30 minutes.
+    @return The previous timeout to hand back to restore(), 0 if the
+            watchdog is off (and then nothing changes).
 */
 /**************************************************************************/
-void WatchdogESP8266::reset() { ESP.wdtFeed(); }
+int WatchdogESP8266::extend(int maxPeriodMS) {
+  int prev = _wdto > 0 ? _wdto : 0;
+  if (prev && maxPeriodMS > 0) {
+    if (maxPeriodMS > 1800000)
+      maxPeriodMS = 1800000;
+    _lastKickUS = micros();
+    _timeoutUS = (uint32_t)maxPeriodMS * 1000;
+    _wdto = maxPeriodMS;
+  }
+  return prev;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Goes back to the timeout extend() returned, kicking the
+            watchdog.
+    @param    prev
+              Value returned by extend().
+*/
+/**************************************************************************/
+void WatchdogESP8266::restore(int prev) {
+  if (prev > 0) {
+    _lastKickUS = micros();
+    _timeoutUS = (uint32_t)prev * 1000;
+    _wdto = prev;
+  }
+  reset();
+}
 
 /**************************************************************************/
 /*!
@@ -44,7 +207,139 @@ void WatchdogESP8266::reset() { ESP.wdtFeed(); }
         watchdog reset!
 */
 /**************************************************************************/
-void WatchdogESP8266::disable() { ESP.wdtDisable(); }
+void WatchdogESP8266::disable() {
+  timer0_detachInterrupt();
+  _wdto = 0;
+  ESP.wdtDisable();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decodes the cause of the last reset.
+    @return The cause of the last reset.
+*/
+/**************************************************************************/
+WatchdogResetCause WatchdogESP8266::resetReason() {
+  if (_fired)
+    return WATCHDOG_RESET_WATCHDOG;
+  switch (ESP.getResetInfoPtr()->reason) {
+  case REASON_WDT_RST:
+  case REASON_SOFT_WDT_RST:
+    return WATCHDOG_RESET_WATCHDOG;
+  case REASON_EXCEPTION_RST:
+    return WATCHDOG_RESET_FAULT;
+  case REASON_SOFT_RESTART:
+    return WATCHDOG_RESET_SOFTWARE;
+  case REASON_DEEP_SLEEP_AWAKE:
+    return WATCHDOG_RESET_WAKE;
+  case REASON_EXT_SYS_RST:
+    return WATCHDOG_RESET_EXTERNAL;
+  case REASON_DEFAULT_RST:
+    return WATCHDOG_RESET_POWER_ON;
+  default:
+    return WATCHDOG_RESET_UNKNOWN;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decodes the cause of the last reset.  RAM doesn't survive a
+            reset on the ESP8266, so there are no breadcrumbs, but the SDK
+            keeps the address of the watchdog or exception reset.
+    @param  info
+            Filled in with the report.
+*/
+/**************************************************************************/
+void WatchdogESP8266::lastReset(WatchdogResetInfo &info) {
+  info.cause = resetReason();
+  WatchdogCrumbs::report(info);
+  if (!_fired && (info.cause == WATCHDOG_RESET_WATCHDOG ||
+                  info.cause == WATCHDOG_RESET_FAULT)) {
+    info.captured = true;
+    info.pc = ESP.getResetInfoPtr()->epc1;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Saves application state, along with what's needed to reconnect
+            to the current access point quickly, in RTC user memory ahead
+            of a deep sleep().  Deep sleep wakes up through a reset, so
+            call resume() and resumeWiFi() from setup() to pick up where
+            the sketch left off instead of starting from scratch.
+    @param    state
+              State to save, may be NULL if len is 0.
+    @param    len
+              Size of the state, up to WATCHDOG_CHECKPOINT_SIZE bytes.
+    @return True on success, false if the state is too large.
+*/
+/**************************************************************************/
+bool WatchdogESP8266::checkpoint(const void *state, uint16_t len) {
+  if (len > WATCHDOG_CHECKPOINT_SIZE)
+    return false;
+
+  WatchdogCheckpoint cp;
+  memset(&cp, 0, sizeof(cp));
+  cp.magic = WATCHDOG_CHECKPOINT_MAGIC;
+  cp.len = len;
+  if (wifi_station_get_connect_status() == STATION_GOT_IP) {
+    struct station_config conf;
+    wifi_station_get_config(&conf);
+    cp.channel = wifi_get_channel();
+    memcpy(cp.bssid, conf.bssid, sizeof(cp.bssid));
+  }
+  if (len)
+    memcpy(cp.data, state, len);
+  cp.crc = _checkpointCRC(cp);
+
+  // Only write as many blocks as are used, RTC memory writes aren't free
+  return ESP.rtcUserMemoryWrite(WATCHDOG_CHECKPOINT_RTC_OFFSET,
+                                (uint32_t *)&cp,
+                                (offsetof(WatchdogCheckpoint, data) + len + 3) &
+                                    ~3);
+}
+
+/**************************************************************************/
+/*!
+    @brief  After waking from deep sleep, copies the state saved by
+            checkpoint() back.
+    @param    state
+              Where to copy the state to.
+    @param    len
+              Size of the state, must match what was saved.
+    @return True if the state was restored, false after any other kind of
+            reset or if nothing valid of that size was saved.
+*/
+/**************************************************************************/
+bool WatchdogESP8266::resume(void *state, uint16_t len) {
+  WatchdogCheckpoint cp;
+  if (!_readCheckpoint(cp) || cp.len != len)
+    return false;
+  memcpy(state, cp.data, len);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  After waking from deep sleep, gets the access point the station
+            was connected to at checkpoint() time.  Passing both to
+            WiFi.begin(ssid, pass, channel, bssid) skips the scan and gets
+            the station back online much faster.
+    @param    channel
+              Set to the WiFi channel.
+    @param    bssid
+              Set to the access point's BSSID.
+    @return True if there is fast-connect data, false otherwise.
+*/
+/**************************************************************************/
+bool WatchdogESP8266::resumeWiFi(uint8_t &channel, uint8_t bssid[6]) {
+  WatchdogCheckpoint cp;
+  if (!_readCheckpoint(cp) || !cp.channel)
+    return false;
+  channel = cp.channel;
+  memcpy(bssid, cp.bssid, sizeof(cp.bssid));
+  return true;
+}
 
 /**************************************************************************/
 /*!
@@ -19,19 +19,51 @@
 // #include "esp_task_wdt.h"
 #include "Esp.h"
 
+#include "WatchdogBase.h"
+
+#ifndef WATCHDOG_CHECKPOINT_SIZE
+/** Largest block of state that checkpoint() can save, in bytes. */
+#define WATCHDOG_CHECKPOINT_SIZE 128
+#endif
+
 /**************************************************************************/
 /*!
     @brief  Class that contains functions for interacting with the
             ESP8266's WDT and low-power sleep functions.
 */
 /**************************************************************************/
-class WatchdogESP8266 {
+class WatchdogESP8266 : public WatchdogBase<WatchdogESP8266> {
 public:
   WatchdogESP8266() : _wdto(-1){};
+
+  /// Capabilities, for generic code to branch on at compile time (see
+  /// WatchdogBase.h).
+  static constexpr bool canDisable = true;
+  static constexpr int32_t minPeriod = 1;
+  static constexpr int32_t maxPeriod = 1800000;
+  static constexpr int32_t periodGranularity = 1;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
+
   int enable(int maxPeriodMS = 0);
   void reset();
+  /*!
+      @brief  Tells the current timeout (extended or not).
+      @return The timeout in milliseconds, 0 when off.
+  */
+  int period() { return _wdto > 0 ? _wdto : 0; }
+  int extend(int maxPeriodMS);
+  void restore(int prev);
   void disable();
   int sleep(int maxPeriodMS = 0);
+  int sleepUntil(const WatchdogWakeSource *sources, uint8_t count,
+                 int maxPeriodMS = 0)
+      __attribute__((error("ESP8266 sleep() wakes up through a reset")));
+  WatchdogResetCause resetReason();
+  void lastReset(WatchdogResetInfo &info);
+  bool checkpoint(const void *state, uint16_t len);
+  bool resume(void *state, uint16_t len);
+  bool resumeWiFi(uint8_t &channel, uint8_t bssid[6]);
 
 private:
   int _wdto;
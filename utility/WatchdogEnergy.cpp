@@ -0,0 +1,85 @@
+#include "WatchdogEnergy.h"
+#include "WatchdogBase.h"
+
+WatchdogEnergyStats WatchdogEnergy::_stats;
+WatchdogCurrentTable WatchdogEnergy::_currents;
+uint32_t WatchdogEnergy::_awakeSince;
+
+/**************************************************************************/
+/*!
+    @brief  Called by sleep() before it goes to sleep, ends a stretch of
+            time awake.  If it then can't sleep after all and doesn't call
+            sleepEnd(), the time goes on counting as awake.
+*/
+/**************************************************************************/
+void WatchdogEnergy::sleepBegin() {
+  uint32_t now = watchdog_millis();
+  _stats.awakeMS += now - _awakeSince;
+  _awakeSince = now;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Called by sleep() on its way out, once it did sleep.
+    @param  mode
+            The WatchdogSleepMode it slept in.
+    @param  sleptMS
+            Time asleep, as sleep() returns it.
+    @param  early
+            Whether something else than the sleep timer woke the chip up.
+*/
+/**************************************************************************/
+void WatchdogEnergy::sleepEnd(uint8_t mode, int sleptMS, bool early) {
+  // Read after sleeping, so that the time asleep doesn't count as awake
+  // where millis() keeps running through sleep.
+  _awakeSince = watchdog_millis();
+  if (sleptMS > 0)
+    _stats.sleepMS[mode] += sleptMS;
+  _stats.wakes++;
+  if (early)
+    _stats.earlyWakes++;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Copy the counters out, with the charge they add up to.
+    @param  stats
+            Filled in with the counters.
+*/
+/**************************************************************************/
+void WatchdogEnergy::stats(WatchdogEnergyStats &stats) {
+  stats = _stats;
+  stats.awakeMS += watchdog_millis() - _awakeSince;
+
+  uint64_t totalMS = stats.awakeMS;
+  uint64_t chargeUAms = stats.awakeMS * _currents.awakeUA;
+  for (uint8_t i = 0; i < WATCHDOG_SLEEP_MODES; i++) {
+    totalMS += stats.sleepMS[i];
+    chargeUAms += stats.sleepMS[i] * _currents.sleepUA[i];
+  }
+  stats.chargeUAh = chargeUAms / 3600000UL;
+  stats.averageUA = totalMS ? chargeUAms / totalMS : 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set the current the board draws in each state, for stats() to
+            estimate the charge drawn.
+    @param  table
+            Currents in microamps, from the datasheet or measured once.
+*/
+/**************************************************************************/
+void WatchdogEnergy::setCurrents(const WatchdogCurrentTable &table) {
+  _currents = table;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Start the counters over from now.
+*/
+/**************************************************************************/
+void WatchdogEnergy::clear() {
+  WatchdogEnergyStats zero = {};
+  _stats = zero;
+  _awakeSince = watchdog_millis();
+}
@@ -0,0 +1,69 @@
+/*!
+ * @file WatchdogEnergy.h
+ *
+ * Duty cycle accounting shared by the watchdog backends: time spent awake
+ * and asleep in each sleep mode, wake-ups, and an estimate of the charge
+ * drawn from a table of the board's currents.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGENERGY_H_
+#define WATCHDOGENERGY_H_
+
+#include <stdint.h>
+
+/** Sleep modes sleep() can use, depending on the backend. */
+typedef enum {
+  /** CPU halted, clocks running: 32u4 idle with USB up, nRF52 System ON,
+      RP2350 sleep_ms(), Teensy 4 WAIT, Linux nanosleep(). */
+  WATCHDOG_SLEEP_IDLE,
+  /** Most clocks stopped, RAM kept: AVR power-down, SAMD standby, Teensy
+      VLPS, RP2040 clock gated sleep, ESP32 light sleep, STM32F4 STOP. */
+  WATCHDOG_SLEEP_STOP,
+  WATCHDOG_SLEEP_MODES ///< Number of sleep modes
+} WatchdogSleepMode;
+
+/** Current drawn by the board in each state, in microamps. */
+typedef struct {
+  uint32_t awakeUA;                       ///< Running
+  uint32_t sleepUA[WATCHDOG_SLEEP_MODES]; ///< Asleep, per WatchdogSleepMode
+} WatchdogCurrentTable;
+
+/** Counters since boot (or clearEnergy()). */
+typedef struct {
+  uint64_t awakeMS;                       ///< Time spent outside sleep()
+  uint64_t sleepMS[WATCHDOG_SLEEP_MODES]; ///< Time asleep, per mode
+  uint32_t wakes;                         ///< Number of times sleep() woke up
+  uint32_t earlyWakes;                    ///< Woke up before the time asked for
+  uint32_t chargeUAh;                     ///< Charge drawn, 0 without currents
+  uint32_t averageUA;                     ///< Mean current, 0 without currents
+} WatchdogEnergyStats;
+
+/**************************************************************************/
+/*!
+    @brief  Counters kept by the backends' sleep(): they call sleepBegin()
+            on the way in and sleepEnd() on the way out, and the time in
+            between two sleeps counts as awake.  Deep sleeps that end in a
+            reset (ESP8266 sleep(), ESP32 deepSleep()) start them over.
+*/
+/**************************************************************************/
+class WatchdogEnergy {
+public:
+  static void sleepBegin();
+  static void sleepEnd(uint8_t mode, int sleptMS, bool early);
+  static void stats(WatchdogEnergyStats &stats);
+  static void setCurrents(const WatchdogCurrentTable &table);
+  static void clear();
+
+private:
+  static WatchdogEnergyStats _stats;
+  static WatchdogCurrentTable _currents;
+  static uint32_t _awakeSince;
+};
+
+#endif // WATCHDOGENERGY_H_
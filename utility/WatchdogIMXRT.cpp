@@ -0,0 +1,210 @@
+// Be careful to use a platform-specific conditional include to only make the
+// code visible for the appropriate platform.  Arduino will try to compile and
+// link all .cpp files regardless of platform.
+#if defined(__IMXRT1062__)
+
+#include "WatchdogEnergy.h"
+#include "WatchdogIMXRT.h"
+#include "WatchdogTrace.h"
+#include "WatchdogWake.h"
+#include <Arduino.h>
+
+extern "C" volatile uint32_t systick_millis_count;
+
+static void gpt2_isr(void);
+
+// Reset causes as they were at boot.  SRC_SRSR is left for the core's
+// CrashReport to read (and clear), but for the watchdog flags: they are
+// sticky, and a stale one would pass every later reset off as a watchdog
+// reset.  The other flags only matter once those are clear.
+static uint32_t reset_flags;
+
+static struct WatchdogIMXRTBoot {
+  WatchdogIMXRTBoot() {
+    reset_flags = SRC_SRSR;
+    SRC_SRSR = reset_flags & (SRC_SRSR_WDOG_RST_B | SRC_SRSR_WDOG3_RST_B);
+  }
+} _boot;
+
+// The GPT2 clock is the 32 kHz reference, which keeps running in WAIT.
+#define GPT2_HZ 32768
+
+// Watchdog interrupt, right before the reset.  Naked, so that the
+// interrupted pc can be found, it carries on in _watchdogIMXRTTimeout().
+WATCHDOG_CRUMBS_NAKED_ISR(watchdog_isr, _watchdogIMXRTTimeout)
+
+void _watchdogIMXRTTimeout(uint32_t *frame) {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ISR);
+  WatchdogCrumbs::capture(frame[6]);
+  WDOG1_WICR |= WDOG_WICR_WTIS;
+  __asm__ volatile("dsb");
+}
+
+// Enable the watchdog timer to reset the machine after a period of time
+// without any calls to reset().  WDOG1 counts down in half seconds from
+// WT + 1, WT being 8 bits.
+//
+// The actual period (in milliseconds) before a watchdog timer reset is
+// returned.
+int WatchdogIMXRT::enable(int maxPeriodMS) {
+  if (maxPeriodMS <= 0) {
+    maxPeriodMS = 8000; // default is 8 seconds
+  }
+  if (maxPeriodMS < minPeriod)
+    maxPeriodMS = minPeriod;
+  if (maxPeriodMS > maxPeriod)
+    maxPeriodMS = maxPeriod;
+  int wt = maxPeriodMS / 500 - 1;
+
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
+  if (!_wdto) {
+    // The interrupt and its offset are write-once: half a second (one
+    // count) before the reset, just enough for watchdog_isr() to note where
+    // the code was stuck.
+    attachInterruptVector(IRQ_WDOG1, watchdog_isr);
+    NVIC_SET_PRIORITY(IRQ_WDOG1, 0);
+    NVIC_ENABLE_IRQ(IRQ_WDOG1);
+    WDOG1_WICR = WDOG_WICR_WIE | WDOG_WICR_WTIS | WDOG_WICR_WICT(1);
+    // The power down counter resets the chip after 16 seconds otherwise.
+    WDOG1_WMCR = 0;
+  }
+  // SRS and WDA are written as 1, a 0 asserts a reset.  WDW and WDZST
+  // suspend the count in WAIT and STOP, where sleep() can't kick it.
+  WDOG1_WCR = WDOG_WCR_WT(wt) | WDOG_WCR_WDW | WDOG_WCR_SRS | WDOG_WCR_WDA |
+              WDOG_WCR_WDE | WDOG_WCR_WDZST;
+  WDOG1_WSR = 0x5555;
+  WDOG1_WSR = 0xAAAA;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
+
+  _wdto = (wt + 1) * 500;
+  return _wdto;
+}
+
+// Reset or 'kick' the watchdog timer to prevent a reset of the device.
+void WatchdogIMXRT::reset() {
+  __disable_irq();
+  WDOG1_WSR = 0x5555;
+  WDOG1_WSR = 0xAAAA;
+  __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+// WT can be changed while the watchdog runs, the new value is loaded on the
+// next kick.
+int WatchdogIMXRT::extend(int maxPeriodMS) {
+  int prev = _wdto;
+  if (prev && maxPeriodMS > 0)
+    enable(maxPeriodMS);
+  return prev;
+}
+
+// Go back to the timeout extend() returned.
+void WatchdogIMXRT::restore(int prev) {
+  if (prev > 0)
+    enable(prev);
+}
+
+// Once enabled, WDOG1 can NOT be disabled.
+void WatchdogIMXRT::disable() {}
+
+// Find out the cause of the last reset, most specific flag first.
+WatchdogResetCause WatchdogIMXRT::resetReason() {
+  if (reset_flags & (SRC_SRSR_WDOG_RST_B | SRC_SRSR_WDOG3_RST_B))
+    return WATCHDOG_RESET_WATCHDOG;
+  if (reset_flags & SRC_SRSR_TEMPSENSE_RST_B)
+    return WATCHDOG_RESET_FAULT;
+  if (reset_flags & (SRC_SRSR_LOCKUP_SYSRESETREQ | SRC_SRSR_JTAG_SW_RST))
+    return WATCHDOG_RESET_SOFTWARE;
+  if (reset_flags & SRC_SRSR_IPP_USER_RESET_B)
+    return WATCHDOG_RESET_EXTERNAL;
+  if (reset_flags & SRC_SRSR_IPP_RESET_B)
+    return WATCHDOG_RESET_POWER_ON;
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+static void gpt2_isr(void) {
+  // Stop interrupting but leave the counter running (free running mode
+  // doesn't reset it on compare), the time slept is read back from it.
+  GPT2_IR = 0;
+  GPT2_SR = GPT_SR_OF1;
+  __asm__ volatile("dsb"); // Or the interrupt fires again on the way out
+}
+
+// Enter WAIT mode for the desired period of time: the core clock is gated
+// but the rest of the chip, RAM and peripherals included, keeps going, and
+// GPT2 on the 32 kHz clock wakes it up.
+//
+// The actual period (in milliseconds) that the hardware was asleep will be
+// returned.
+int WatchdogIMXRT::sleep(int maxPeriodMS) {
+  if (maxPeriodMS <= 0)
+    return 0;
+  uint32_t ticks = (uint64_t)maxPeriodMS * GPT2_HZ / 1000;
+  if (!ticks)
+    ticks = 1;
+
+  CCM_CCGR0 |= CCM_CCGR0_GPT2_BUS(CCM_CCGR_ON) |
+               CCM_CCGR0_GPT2_SERIAL(CCM_CCGR_ON);
+  GPT2_CR = 0;
+  GPT2_PR = 0;
+  GPT2_SR = 0x3F;
+  GPT2_OCR1 = ticks; // Compare flag sets as the counter reaches it
+  attachInterruptVector(IRQ_GPT2, gpt2_isr);
+  NVIC_ENABLE_IRQ(IRQ_GPT2);
+  GPT2_IR = GPT_IR_OF1IE;
+  GPT2_CR = GPT_CR_EN | GPT_CR_ENMOD | GPT_CR_WAITEN | GPT_CR_FRR |
+            GPT_CR_CLKSRC(4);
+
+  WatchdogEnergy::sleepBegin();
+  // millis() is caught up from GPT2 instead, the SysTick interrupt would
+  // end the WFI every millisecond.
+  SYST_CSR &= ~SYST_CSR_TICKINT;
+
+  // WAIT mode on the next WFI.  ERR007265: the CCM can move to low power
+  // before the core has reached the WFI unless an interrupt is pending in
+  // the GPC while CLPCR is written, so raise GPR_IRQ (41) for that long.
+  uint32_t clpcr = CCM_CLPCR;
+  uint32_t imr = GPC_IMR1;
+  IOMUXC_GPR_GPR1 |= IOMUXC_GPR_GPR1_GINT;
+  GPC_IMR1 = imr & ~(1UL << (41 - 32));
+  CCM_CLPCR = (clpcr & ~CCM_CLPCR_LPM(3)) | CCM_CLPCR_LPM(1) |
+              CCM_CLPCR_ARM_CLK_DIS_ON_LPM;
+  GPC_IMR1 = imr;
+  IOMUXC_GPR_GPR1 &= ~IOMUXC_GPR_GPR1_GINT;
+
+  // WFI still wakes on a pending interrupt with them masked, so the timer
+  // (or a sleepUntil() pin) can't slip in between the check and the WFI.
+  // Other interrupts only wake the chip briefly, the watchdog counts
+  // meanwhile so it gets a kick.
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+  __disable_irq();
+  while ((GPT2_IR & GPT_IR_OF1IE) && !WatchdogWake::pending()) {
+    __asm__ volatile("dsb");
+    __asm__ volatile("wfi");
+    if (_wdto) {
+      WDOG1_WSR = 0x5555;
+      WDOG1_WSR = 0xAAAA;
+    }
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
+  CCM_CLPCR = clpcr;
+
+  bool early = GPT2_IR & GPT_IR_OF1IE;
+  int slept = early ? (uint64_t)GPT2_CNT * 1000 / GPT2_HZ : maxPeriodMS;
+  GPT2_IR = 0;
+  GPT2_CR = 0;
+  NVIC_DISABLE_IRQ(IRQ_GPT2);
+
+  // Catch millis() up.
+  systick_millis_count += slept;
+  SYST_CSR |= SYST_CSR_TICKINT;
+  if (slept)
+    WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, slept, early);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
+  return slept;
+}
+
+#endif
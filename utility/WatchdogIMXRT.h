@@ -0,0 +1,66 @@
+#ifndef WATCHDOGIMXRT_H
+#define WATCHDOGIMXRT_H
+
+#include <stdint.h>
+
+#include "WatchdogBase.h"
+
+class WatchdogIMXRT : public WatchdogBase<WatchdogIMXRT> {
+public:
+  WatchdogIMXRT() : _wdto(0) {}
+
+  // Capabilities, for generic code to branch on at compile time (see
+  // WatchdogBase.h).
+  static constexpr bool canDisable = false;
+  static constexpr int32_t minPeriod = 1000;
+  static constexpr int32_t maxPeriod = 128000;
+  static constexpr int32_t periodGranularity = 500;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
+
+  // Enable the watchdog timer (WDOG1) to reset the machine after a period
+  // of time without any calls to reset().  The passed in period (in
+  // milliseconds) is rounded down to the half seconds the hardware counts
+  // in, from 1 to 128 seconds, 8 seconds if 0.
+  //
+  // The actual period (in milliseconds) before a watchdog timer reset is
+  // returned.  Half a second before the reset, an interrupt notes where the
+  // code was stuck (see lastReset()).
+  int enable(int maxPeriodMS = 0);
+
+  // Reset or 'kick' the watchdog timer to prevent a reset of the device.
+  void reset();
+
+  // Current timeout in milliseconds (extended or not), 0 when off.
+  int period() { return _wdto; }
+
+  // Change the timeout of the running watchdog (and kick it), for instance
+  // ahead of a long flash write.  Returns the previous timeout (0 if the
+  // watchdog is off, and then nothing changes) to hand back to restore()
+  // afterwards.  See WatchdogExtend for a guard that does both.
+  int extend(int maxPeriodMS);
+
+  // Go back to the timeout extend() returned, kicking the watchdog.
+  void restore(int prev);
+
+  // WDOG1 can't be turned off once enabled.
+  void disable()
+      __attribute__((error("Teensy 4 WDOG1 cannot be disabled once enabled")));
+
+  // Enter WAIT mode (core clock gated, woken up by GPT2 on the 32 kHz
+  // clock) for the desired period of time.  The watchdog is suspended
+  // meanwhile and millis() is caught up on wake.  GPT2 isn't available to
+  // the sketch during sleep().
+  //
+  // The actual period (in milliseconds) that the hardware was asleep will be
+  // returned, measured on GPT2 when something else woke it up first.
+  int sleep(int maxPeriodMS = 0);
+
+  // Find out the cause of the last reset.
+  WatchdogResetCause resetReason();
+
+private:
+  int _wdto;
+};
+
+#endif
@@ -5,10 +5,22 @@
     defined(__MK64FX512__) || defined(__MK66FX1M0__)
 
 #include "WatchdogKinetisK.h"
+#include "WatchdogKinetisSleep.h"
 #include <kinetis.h>
 
 static void one_bus_cycle(void) __attribute__((always_inline));
 static void watchdog_config(int cfg, int val);
+static void watchdog_unlock(void);
+static void wct_wait(void);
+
+// A new configuration only takes effect once the WCT (watchdog
+// configuration time, 256 bus cycles from the unlock) is over, and the
+// watchdog mustn't be unlocked or refreshed again before that.  Rather than
+// stalling through it after every change, note when it started and only
+// wait for what's left of it (usually nothing) before the next access.
+#define WDOG_WCT_CYCLES (256 * (F_CPU / F_BUS))
+static volatile bool wct_pending;
+static volatile uint32_t wct_start;
 
 // Enable the watchdog timer to reset the machine after a period of time
 // without any calls to reset().  The passed in period (in milliseconds) is
@@ -21,19 +33,68 @@ int WatchdogKinetisKseries::enable(int maxPeriodMS) {
   if (maxPeriodMS < 4) {
     maxPeriodMS = 8000; // default is 8 seconds
   }
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
   if (setting != maxPeriodMS) {
-    watchdog_config(WDOG_STCTRLH_WDOGEN, maxPeriodMS);
+    // Interrupt first, then reset 256 bus cycles later: just enough for
+    // watchdog_isr() to note where the code was stuck.
+    NVIC_SET_PRIORITY(IRQ_WDOG, 0);
+    NVIC_ENABLE_IRQ(IRQ_WDOG);
+    watchdog_config(WDOG_STCTRLH_WDOGEN | WDOG_STCTRLH_IRQRSTEN, maxPeriodMS);
     setting = maxPeriodMS;
   }
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
   return maxPeriodMS;
 }
 
 // Reset or 'kick' the watchdog timer to prevent a reset of the device.
 void WatchdogKinetisKseries::reset() {
+  wct_wait();
   __disable_irq();
   WDOG_REFRESH = 0xA602;
   WDOG_REFRESH = 0xB480;
   __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+// Kick the watchdog without masking interrupts.  The two refresh writes
+// must land within 20 bus cycles of each other, a pair an interrupt pushed
+// further apart just doesn't count, so time it on the cycle counter
+// (running since enable()) and write it again.
+#define WDOG_REFRESH_CYCLES (20 * (F_CPU / F_BUS))
+
+void WatchdogKinetisKseries::resetLowLatency() {
+  wct_wait();
+  uint32_t start;
+  do {
+    start = ARM_DWT_CYCCNT;
+    WDOG_REFRESH = 0xA602;
+    WDOG_REFRESH = 0xB480;
+  } while (ARM_DWT_CYCCNT - start > WDOG_REFRESH_CYCLES);
+}
+
+// Change the timeout without touching the rest of the configuration, this
+// only takes an unlock and two register writes.
+int WatchdogKinetisKseries::extend(int maxPeriodMS) {
+  int prev = setting;
+  if (setting <= 0 || maxPeriodMS < 4 || maxPeriodMS == setting)
+    return prev;
+  wct_wait();
+  __disable_irq();
+  watchdog_unlock();
+  WDOG_TOVALH = maxPeriodMS >> 16;
+  WDOG_TOVALL = maxPeriodMS;
+  __enable_irq();
+  setting = maxPeriodMS;
+  return prev;
+}
+
+// Go back to the timeout extend() returned.  Kick first: the counter may
+// already be past the shorter timeout by now.
+void WatchdogKinetisKseries::restore(int prev) {
+  if (prev > 0) {
+    reset();
+    extend(prev);
+  }
 }
 
 // Completely disable the watchdog timer.
@@ -44,32 +105,78 @@ void WatchdogKinetisKseries::disable() {
   }
 }
 
+// Find out the cause of the last reset.
+WatchdogResetCause WatchdogKinetisKseries::resetReason() {
+  if (RCM_SRS0 & RCM_SRS0_WDOG)
+    return WATCHDOG_RESET_WATCHDOG;
+  if (RCM_SRS1 & RCM_SRS1_LOCKUP)
+    return WATCHDOG_RESET_FAULT;
+  if (RCM_SRS1 & (RCM_SRS1_SW | RCM_SRS1_MDM_AP))
+    return WATCHDOG_RESET_SOFTWARE;
+  if (RCM_SRS0 & RCM_SRS0_LVD)
+    return WATCHDOG_RESET_BROWNOUT;
+  if (RCM_SRS0 & RCM_SRS0_WAKEUP)
+    return WATCHDOG_RESET_WAKE;
+  if (RCM_SRS0 & RCM_SRS0_PIN)
+    return WATCHDOG_RESET_EXTERNAL;
+  if (RCM_SRS0 & RCM_SRS0_POR)
+    return WATCHDOG_RESET_POWER_ON;
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+// Watchdog interrupt, right before the reset.  Naked, so that the
+// interrupted pc can be found, it carries on in _watchdogKinetisTimeout().
+WATCHDOG_CRUMBS_NAKED_ISR(watchdog_isr, _watchdogKinetisTimeout)
+
+void _watchdogKinetisTimeout(uint32_t *frame) {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ISR);
+  WatchdogCrumbs::capture(frame[6]);
+  WDOG_STCTRLL = WDOG_STCTRLL_INTFLG;
+}
+
 // Enter the lowest power sleep mode for the desired period of time.  The
-// passed in period (in milliseconds) is just a suggestion and a lower value
-// might be picked if the hardware does not support the exact desired value
+// watchdog doesn't count in stop modes (STOPEN is left clear), so it can't
+// fire meanwhile.
 //
 // The actual period (in milliseconds) that the hardware was asleep will be
 // returned.
 int WatchdogKinetisKseries::sleep(int maxPeriodMS) {
   if (maxPeriodMS <= 0)
     return 0;
-  // TODO....
-  return 0;
+  return watchdog_kinetis_sleep(maxPeriodMS, WATCHDOG_LPTMR_MAX_MS, NULL);
 }
 
 static void watchdog_config(int cfg, int val) {
+  wct_wait();
   __disable_irq();
-  WDOG_UNLOCK = WDOG_UNLOCK_SEQ1;
-  WDOG_UNLOCK = WDOG_UNLOCK_SEQ2;
-  one_bus_cycle();
+  watchdog_unlock();
   WDOG_STCTRLH = cfg | WDOG_STCTRLH_ALLOWUPDATE;
   WDOG_TOVALH = val >> 16;
   WDOG_TOVALL = val;
   WDOG_PRESC = 0;
   __enable_irq();
-  for (int i = 0; i < 256; i++) {
-    one_bus_cycle();
-  }
+}
+
+// Must be called with interrupts disabled, the configuration registers
+// have to be written within the WCT.
+static void watchdog_unlock(void) {
+  // The cycle counter times the WCT, the Teensy startup code usually has it
+  // running already.
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  WDOG_UNLOCK = WDOG_UNLOCK_SEQ1;
+  WDOG_UNLOCK = WDOG_UNLOCK_SEQ2;
+  wct_start = ARM_DWT_CYCCNT;
+  wct_pending = true;
+  one_bus_cycle();
+}
+
+static void wct_wait(void) {
+  if (!wct_pending)
+    return;
+  while (ARM_DWT_CYCCNT - wct_start < WDOG_WCT_CYCLES)
+    ;
+  wct_pending = false;
 }
 
 static void one_bus_cycle(void) {
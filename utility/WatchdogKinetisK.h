@@ -1,10 +1,24 @@
 #ifndef WATCHDOGKINETISK_H
 #define WATCHDOGKINETISK_H
 
-class WatchdogKinetisKseries {
+#include <stdint.h>
+
+#include "WatchdogBase.h"
+
+class WatchdogKinetisKseries
+    : public WatchdogBase<WatchdogKinetisKseries> {
 public:
   WatchdogKinetisKseries() : setting(0) {}
 
+  // Capabilities, for generic code to branch on at compile time (see
+  // WatchdogBase.h).
+  static constexpr bool canDisable = true;
+  static constexpr int32_t minPeriod = 4;
+  static constexpr int32_t maxPeriod = 2147483647;
+  static constexpr int32_t periodGranularity = 1;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
+
   // Enable the watchdog timer to reset the machine after a period of time
   // without any calls to reset().  The passed in period (in milliseconds) is
   // just a suggestion and a lower value might be picked if the hardware does
@@ -17,20 +31,43 @@ public:
   // Reset or 'kick' the watchdog timer to prevent a reset of the device.
   void reset();
 
+  // Current timeout in milliseconds (extended or not), 0 when off.
+  int period() { return setting > 0 ? setting : 0; }
+
+  // Kick the watchdog without masking interrupts at all.  The two refresh
+  // writes must land within 20 bus cycles of each other, and a pair an
+  // interrupt came in between of doesn't count, so it's timed and written
+  // again if needed.  Safe as long as no interrupt kicks it too.  See the
+  // KickLatency example for the latency it saves.
+  void resetLowLatency();
+
+  // Change the timeout of the running watchdog, for instance ahead of a
+  // long flash write, counted from the last kick.  Unlike enable() this
+  // doesn't rewrite the whole configuration, and neither waits out the
+  // 256 bus cycle configuration window: it's only waited for (if still
+  // open) before the next kick or change, so this costs a microsecond or
+  // so.  Returns the previous timeout (0 if the watchdog is off, and then
+  // nothing changes) to hand back to restore() afterwards.
+  int extend(int maxPeriodMS);
+
+  // Go back to the timeout extend() returned, kicking the watchdog.  See
+  // WatchdogExtend for a guard that does both.
+  void restore(int prev);
+
   // Completely disable the watchdog timer.
   void disable();
 
-  // Enter the lowest power sleep mode (using the watchdog timer) for the
-  // desired period of time.  The passed in period (in milliseconds) is
-  // just a suggestion and a lower value might be picked if the hardware does
-  // not support the exact desired value
+  // Enter the lowest power sleep mode (VLPS, woken up by the low power
+  // timer) for the desired period of time.  USB and everything else clocked
+  // from the MCG stops meanwhile, millis() is caught up on wake.
   //
   // The actual period (in milliseconds) that the hardware was asleep will be
-  // returned.
-  //
-  // NOTE: This is currently not implemented on the SAMD21!
+  // returned, 0 if it couldn't sleep (Teensy 3.6 above 120 MHz).
   int sleep(int maxPeriodMS = 0);
 
+  // Find out the cause of the last reset.
+  WatchdogResetCause resetReason();
+
 private:
   int setting;
 };
@@ -4,8 +4,13 @@
 #if defined(__MKL26Z64__)
 
 #include "WatchdogKinetisL.h"
+#include "WatchdogKinetisSleep.h"
 #include <kinetis.h>
 
+// State of extend(), see below.
+static volatile int extend_left; // ms until the deadline
+static int extend_ms;            // Timeout while extended, 0 = not
+
 // Normally the watchdog is disabled at startup.  This removes the startup
 // code.  The watchdog will be active with 1024 ms timeout.  Hopefully the
 // user will configure the watchdog and begin resetting it before it causes
@@ -23,6 +28,7 @@ extern "C" void startup_early_hook(void) {}
 int WatchdogKinetisLseries::enable(int maxPeriodMS) {
   // The watchdog can only be programmed once.  Then it's forever
   // locked to this setting (until the chip reboots).
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
   if (maxPeriodMS <= 0 || maxPeriodMS > 256) {
     SIM_COPC = 12;
   } else if (maxPeriodMS > 32) {
@@ -30,6 +36,7 @@ int WatchdogKinetisLseries::enable(int maxPeriodMS) {
   } else {
     SIM_COPC = 4;
   }
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
   // Read the actual setting.
   int val = SIM_COPC & 12;
   if (val == 12)
@@ -45,6 +52,18 @@ void WatchdogKinetisLseries::reset() {
   SIM_SRVCOP = 0x55;
   SIM_SRVCOP = 0xAA;
   __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+// Kick the watchdog without masking interrupts.
+void WatchdogKinetisLseries::resetLowLatency() {
+  // Unless extend() kicks it from the LPTMR interrupt, too.
+  if (extend_ms) {
+    reset();
+    return;
+  }
+  SIM_SRVCOP = 0x55;
+  SIM_SRVCOP = 0xAA;
 }
 
 // Completely disable the watchdog timer.
@@ -56,17 +75,129 @@ void WatchdogKinetisLseries::disable() {
   // remains locked to that setting, until a reboot.
 }
 
+// Find out the cause of the last reset.
+WatchdogResetCause WatchdogKinetisLseries::resetReason() {
+  if (RCM_SRS0 & RCM_SRS0_WDOG) // COP timeout
+    return WATCHDOG_RESET_WATCHDOG;
+  if (RCM_SRS1 & RCM_SRS1_LOCKUP)
+    return WATCHDOG_RESET_FAULT;
+  if (RCM_SRS1 & (RCM_SRS1_SW | RCM_SRS1_MDM_AP))
+    return WATCHDOG_RESET_SOFTWARE;
+  if (RCM_SRS0 & RCM_SRS0_LVD)
+    return WATCHDOG_RESET_BROWNOUT;
+  if (RCM_SRS0 & RCM_SRS0_WAKEUP)
+    return WATCHDOG_RESET_WAKE;
+  if (RCM_SRS0 & RCM_SRS0_PIN)
+    return WATCHDOG_RESET_EXTERNAL;
+  if (RCM_SRS0 & RCM_SRS0_POR)
+    return WATCHDOG_RESET_POWER_ON;
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+// The COP keeps counting the LPO whenever it is its clock, so sleep() kicks
+// it between chunks.
+static void watchdog_cop_kick(void) {
+  SIM_SRVCOP = 0x55;
+  SIM_SRVCOP = 0xAA;
+}
+
+// COP timeout as programmed by enable() (or left at 1024 ms), 0 if off.
+static int cop_period_ms(void) {
+  switch (SIM_COPC & 12) {
+  case 12:
+    return 1024;
+  case 8:
+    return 256;
+  case 4:
+    return 32;
+  default:
+    return 0;
+  }
+}
+
+// Software deadline for extend(): the LPTMR interrupts every half COP
+// period and kicks it while the extended deadline is further away than a
+// whole period, then lets it run out.
+static void extend_stop(void) {
+  watchdog_lptmr_hook = NULL;
+  LPTMR0_CSR = 0;
+  NVIC_DISABLE_IRQ(IRQ_LPTMR);
+  extend_left = 0;
+  extend_ms = 0;
+}
+
+static void extend_feed(void) {
+  LPTMR0_CSR = LPTMR_CSR_TEN | LPTMR_CSR_TIE | LPTMR_CSR_TCF;
+  int period = cop_period_ms();
+  int left = extend_left - period / 2;
+  if (left > period) {
+    watchdog_cop_kick();
+    extend_left = left;
+  } else {
+    extend_stop();
+  }
+}
+
+static void extend_start(int ms) {
+  extend_left = ms;
+  SIM_SCGC5 |= SIM_SCGC5_LPTIMER;
+  LPTMR0_CSR = 0;
+  LPTMR0_PSR = LPTMR_PSR_PBYP | LPTMR_PSR_PCS(1); // LPO, no prescaler
+  LPTMR0_CMR = cop_period_ms() / 2 - 1; // Counter restarts on compare
+  watchdog_lptmr_hook = extend_feed;
+  NVIC_ENABLE_IRQ(IRQ_LPTMR);
+  LPTMR0_CSR = LPTMR_CSR_TEN | LPTMR_CSR_TIE;
+}
+
+int WatchdogKinetisLseries::extend(int maxPeriodMS) {
+  int period = cop_period_ms();
+  if (!period)
+    return 0;
+  int prev = extend_ms ? extend_ms : period;
+  watchdog_cop_kick();
+  __disable_irq();
+  if (maxPeriodMS > period) {
+    extend_start(maxPeriodMS);
+    extend_ms = maxPeriodMS;
+  } else {
+    extend_stop();
+  }
+  __enable_irq();
+  return prev;
+}
+
+int WatchdogKinetisLseries::period() {
+  return extend_ms ? extend_ms : cop_period_ms();
+}
+
+void WatchdogKinetisLseries::restore(int prev) {
+  if (prev > 0)
+    extend(prev);
+}
+
 // Enter the lowest power sleep mode for the desired period of time.  The
-// passed in period (in milliseconds) is just a suggestion and a lower value
-// might be picked if the hardware does not support the exact desired value
+// COP can't be turned off, so the chip wakes up to kick it every half
+// period.  The LPTMR is needed for that, an extend() in progress carries
+// on afterwards.
 //
 // The actual period (in milliseconds) that the hardware was asleep will be
 // returned.
 int WatchdogKinetisLseries::sleep(int maxPeriodMS) {
   if (maxPeriodMS <= 0)
     return 0;
-  // TODO....
-  return 0;
+  int period = cop_period_ms();
+  int left = extend_left;
+  int ms = extend_ms;
+  if (ms)
+    extend_stop();
+  int slept = watchdog_kinetis_sleep(
+      maxPeriodMS, period ? period / 2 : WATCHDOG_LPTMR_MAX_MS,
+      watchdog_cop_kick);
+  if (ms && left - slept > period) {
+    extend_start(left - slept);
+    extend_ms = ms;
+  }
+  return slept;
 }
 
 #endif
@@ -1,10 +1,24 @@
 #ifndef WATCHDOGKINETISL_H
 #define WATCHDOGKINETISL_H
 
-class WatchdogKinetisLseries {
+#include <stdint.h>
+
+#include "WatchdogBase.h"
+
+class WatchdogKinetisLseries
+    : public WatchdogBase<WatchdogKinetisLseries> {
 public:
   WatchdogKinetisLseries() {}
 
+  // Capabilities, for generic code to branch on at compile time (see
+  // WatchdogBase.h).
+  static constexpr bool canDisable = false;
+  static constexpr int32_t minPeriod = 32;
+  static constexpr int32_t maxPeriod = 1024;
+  static constexpr int32_t periodGranularity = 0;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
+
   // Enable the watchdog timer to reset the machine after a period of time
   // without any calls to reset().  The passed in period (in milliseconds) is
   // just a suggestion and a lower value might be picked if the hardware does
@@ -17,19 +31,40 @@ public:
   // Reset or 'kick' the watchdog timer to prevent a reset of the device.
   void reset();
 
+  // Current timeout in milliseconds (extended or not), 0 when off.
+  int period();
+
+  // Kick the watchdog without masking interrupts at all.  The COP service
+  // sequence has no timing window, only the order of the two writes
+  // matters, so this is safe as long as no interrupt kicks it too (while
+  // extend() is in effect this falls back to reset()).
+  void resetLowLatency();
+
+  // Lengthen the timeout for a while, for instance ahead of a long flash
+  // write.  The COP is write-once, so the low power timer kicks it instead
+  // until the new deadline, counted from now, is near.  Returns the
+  // previous timeout (0 if the COP is off, and then nothing changes) to
+  // hand back to restore() afterwards.  See WatchdogExtend for a guard that
+  // does both.
+  int extend(int maxPeriodMS);
+
+  // Go back to the timeout extend() returned, kicking the watchdog.
+  void restore(int prev);
+
   // Completely disable the watchdog timer.
   void disable();
 
-  // Enter the lowest power sleep mode (using the watchdog timer) for the
-  // desired period of time.  The passed in period (in milliseconds) is
-  // just a suggestion and a lower value might be picked if the hardware does
-  // not support the exact desired value
+  // Enter the lowest power sleep mode (VLPS, woken up by the low power
+  // timer) for the desired period of time.  USB and everything else clocked
+  // from the MCG stops meanwhile, millis() is caught up on wake.
   //
   // The actual period (in milliseconds) that the hardware was asleep will be
-  // returned.
-  //
-  // NOTE: This is currently not implemented on the SAMD21!
+  // returned, 0 if it couldn't sleep (Teensy 3.6 above 120 MHz).
   int sleep(int maxPeriodMS = 0);
+
+  // Find out the cause of the last reset.
+  WatchdogResetCause resetReason();
+
 };
 
 #endif
@@ -0,0 +1,112 @@
+// Low power timer (LPTMR) sleep shared by the Teensy 3.x and LC watchdog
+// backends, only included from their .cpp files (which never build
+// together, so the interrupt handler below is only ever defined once).
+//
+// The LPTMR counts the 1 kHz LPO, which keeps running in VLPS (very low
+// power stop), and wakes the chip back up.  Everything clocked from the
+// MCG, USB and SysTick included, stops meanwhile.
+#ifndef WATCHDOGKINETISSLEEP_H
+#define WATCHDOGKINETISSLEEP_H
+
+#include <kinetis.h>
+#include <stddef.h>
+
+#include "WatchdogEnergy.h"
+#include "WatchdogTrace.h"
+#include "WatchdogWake.h"
+
+extern "C" volatile uint32_t systick_millis_count;
+
+// Longest single sleep, the LPTMR compare register is 16 bits.
+#define WATCHDOG_LPTMR_MAX_MS 65535
+
+// Set while the Teensy LC backend uses the LPTMR to feed the COP, which
+// then gets the timer interrupts instead of sleep.
+static void (*volatile watchdog_lptmr_hook)(void);
+
+extern "C" void lptmr_isr(void) {
+  if (watchdog_lptmr_hook) {
+    watchdog_lptmr_hook();
+    return;
+  }
+  // Stop interrupting but leave the counter running (free running mode
+  // doesn't reset it on compare), the time slept is read back from it.
+  LPTMR0_CSR = LPTMR_CSR_TEN | LPTMR_CSR_TFC | LPTMR_CSR_TCF;
+}
+
+// Sleep in VLPS for 1 to WATCHDOG_LPTMR_MAX_MS milliseconds.  Returns the
+// time actually slept, 0 if the chip can't stop from its current run mode
+// (HSRUN, Teensy 3.6 above 120 MHz).
+static int watchdog_lptmr_sleep(int ms) {
+  if (SMC_PMSTAT == 0x80) // HSRUN
+    return 0;
+  SIM_SCGC5 |= SIM_SCGC5_LPTIMER;
+  LPTMR0_CSR = 0;
+  LPTMR0_PSR = LPTMR_PSR_PBYP | LPTMR_PSR_PCS(1); // LPO, no prescaler
+  LPTMR0_CMR = ms - 1; // Compare flag sets as the counter moves past it
+  NVIC_ENABLE_IRQ(IRQ_LPTMR);
+  LPTMR0_CSR = LPTMR_CSR_TEN | LPTMR_CSR_TFC | LPTMR_CSR_TIE;
+
+  // VLPS has to be allowed first, that register is write-once and the
+  // Teensy startup code normally already did.
+  SMC_PMPROT = SMC_PMPROT_AVLP;
+  SMC_PMCTRL = (SMC_PMCTRL & ~SMC_PMCTRL_STOPM(7)) | SMC_PMCTRL_STOPM(2);
+  (void)SMC_PMCTRL; // Make sure the write landed before the WFI
+  SCB_SCR |= SCB_SCR_SLEEPDEEP;
+
+  // WFI still wakes on a pending interrupt with them masked, so the timer
+  // (or a sleepUntil() pin) can't slip in between the check and the WFI.
+  // Other interrupts only wake the chip briefly.
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+  __disable_irq();
+  while ((LPTMR0_CSR & LPTMR_CSR_TIE) && !WatchdogWake::pending()) {
+    __asm__ volatile("wfi");
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
+  SCB_SCR &= ~SCB_SCR_SLEEPDEEP;
+
+  // The PLL stops in VLPS, the MCG switches back to it once it relocks.
+  if (MCG_S & MCG_S_PLLST) {
+    while (!(MCG_S & MCG_S_LOCK0))
+      ;
+  }
+
+  LPTMR0_CNR = 0; // Latches the counter so it can be read
+  int slept = LPTMR0_CNR;
+  LPTMR0_CSR = 0;
+  NVIC_DISABLE_IRQ(IRQ_LPTMR);
+
+  // SysTick was stopped too, catch millis() up.
+  systick_millis_count += slept;
+  return slept;
+}
+
+// Sleep for maxPeriodMS in chunks of at most chunkMS, calling kick (if any)
+// in between.  Returns the time actually slept.
+static int watchdog_kinetis_sleep(int maxPeriodMS, int chunkMS,
+                                  void (*kick)(void)) {
+  if (chunkMS > WATCHDOG_LPTMR_MAX_MS)
+    chunkMS = WATCHDOG_LPTMR_MAX_MS;
+  WatchdogEnergy::sleepBegin();
+  int slept = 0;
+  while (slept < maxPeriodMS) {
+    int ms = maxPeriodMS - slept;
+    if (ms > chunkMS)
+      ms = chunkMS;
+    int chunk = watchdog_lptmr_sleep(ms);
+    if (kick)
+      kick();
+    slept += chunk;
+    if (chunk < ms)
+      break;
+  }
+  if (slept)
+    WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_STOP, slept, slept < maxPeriodMS);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
+  return slept;
+}
+
+#endif
@@ -4,12 +4,16 @@
 #include "Arduino.h"
 #include "nrf_wdt.h"
 
+// How often sleep() checks whether a sleepUntil() pin fired, in ms.
+#define WATCHDOG_NRF_WAKE_STEP_MS 10
+
 WatchdogNRF::WatchdogNRF() { _wdto = -1; }
 
 int WatchdogNRF::enable(int maxPeriodMS) {
   if (maxPeriodMS < 0)
     return 0;
 
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
   // cannot change wdt config register once it is started
   // return previous configured timeout
   if (nrf_wdt_started(NRF_WDT))
@@ -23,6 +27,14 @@ int WatchdogNRF::enable(int maxPeriodMS) {
   // use channel 0
   nrf_wdt_reload_request_enable(NRF_WDT, NRF_WDT_RR0);
 
+#if WATCHDOG_NRF_WDT_IRQ
+  // Timeout interrupt, two 32kHz cycles before the reset: just enough to
+  // note where the code was stuck (priority 2 is free with a SoftDevice)
+  NRF_WDT->INTENSET = WDT_INTENSET_TIMEOUT_Msk;
+  NVIC_SetPriority(WDT_IRQn, 2);
+  NVIC_EnableIRQ(WDT_IRQn);
+#endif
+
   // Start WDT
   // After started CRV, RREN and CONFIG is blocked
   // There is no way to stop/disable watchdog using source code
@@ -30,31 +42,250 @@ int WatchdogNRF::enable(int maxPeriodMS) {
   nrf_wdt_task_trigger(NRF_WDT, NRF_WDT_TASK_START);
 
   _wdto = maxPeriodMS;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
 
   return maxPeriodMS;
 }
 
-void WatchdogNRF::reset() { nrf_wdt_reload_request_set(NRF_WDT, NRF_WDT_RR0); }
+void WatchdogNRF::reset() {
+  nrf_wdt_reload_request_set(NRF_WDT, NRF_WDT_RR0);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+static int _extendMS; // Timeout while extended, 0 = not
+
+#if WATCHDOG_NRF_RTC2
+// Software deadline for extend(): RTC2 compare 0 interrupts every half
+// watchdog period and feeds it while the extended deadline is further away
+// than a whole period, then lets it run out.
+static volatile uint32_t _extendLeft; // RTC ticks until the deadline
+static uint32_t _extendFeed;          // RTC ticks between feeds
+
+// RTC2 is shared by extend() (compare 0) and sleep() (compare 1), it only
+// stops once neither uses it.
+static void _rtcRelease(void) {
+  if (!(NRF_RTC2->INTENSET &
+        (RTC_INTENSET_COMPARE0_Msk | RTC_INTENSET_COMPARE1_Msk)))
+    NRF_RTC2->TASKS_STOP = 1;
+}
+
+static void _extendStop(void) {
+  NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE0_Msk;
+  _rtcRelease();
+  _extendLeft = 0;
+  _extendMS = 0;
+}
+
+// Starts RTC2 at 32768 Hz (it wraps every 512 s) on the low frequency
+// clock.  That clock is always running with a SoftDevice (which then owns
+// the CLOCK peripheral), start it otherwise.
+static void _rtcStart(void) {
+  if (!(NRF_CLOCK->LFCLKSTAT & CLOCK_LFCLKSTAT_STATE_Msk)) {
+    NRF_CLOCK->EVENTS_LFCLKSTARTED = 0;
+    NRF_CLOCK->TASKS_LFCLKSTART = 1;
+    while (!NRF_CLOCK->EVENTS_LFCLKSTARTED)
+      ;
+  }
+  NRF_RTC2->PRESCALER = 0;
+  NRF_RTC2->TASKS_START = 1;
+  NVIC_SetPriority(RTC2_IRQn, 3);
+  NVIC_EnableIRQ(RTC2_IRQn);
+}
+
+extern "C" void RTC2_IRQHandler(void) {
+  if (NRF_RTC2->EVENTS_COMPARE[0]) {
+    NRF_RTC2->EVENTS_COMPARE[0] = 0;
+    uint32_t left = _extendLeft - _extendFeed;
+    if (_extendLeft > _extendFeed && left > 2 * _extendFeed) {
+      nrf_wdt_reload_request_set(NRF_WDT, NRF_WDT_RR0);
+      _extendLeft = left;
+      NRF_RTC2->CC[0] =
+          (NRF_RTC2->CC[0] + _extendFeed) & RTC_COUNTER_COUNTER_Msk;
+    } else {
+      _extendStop();
+    }
+  }
+  if (NRF_RTC2->EVENTS_COMPARE[1]) {
+    // End of a sleep() step, which sees the interrupt turned off.
+    NRF_RTC2->EVENTS_COMPARE[1] = 0;
+    NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE1_Msk;
+  }
+}
+#endif
+
+int WatchdogNRF::extend(int maxPeriodMS) {
+#if !WATCHDOG_NRF_RTC2
+  (void)maxPeriodMS;
+  return 0;
+#else
+  int prev = _extendMS ? _extendMS : _wdto;
+  if (prev <= 0)
+    return 0;
+  reset();
+  if (maxPeriodMS <= _wdto) {
+    _extendStop();
+    return prev;
+  }
+
+  NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE0_Msk;
+  _extendFeed = ((uint64_t)_wdto * 32768) / 2000; // Half a period
+  _extendLeft = ((uint64_t)maxPeriodMS * 32768) / 1000;
+  _extendMS = maxPeriodMS;
+  _rtcStart();
+  NRF_RTC2->EVENTS_COMPARE[0] = 0;
+  NRF_RTC2->CC[0] =
+      (NRF_RTC2->COUNTER + _extendFeed) & RTC_COUNTER_COUNTER_Msk;
+  NRF_RTC2->INTENSET = RTC_INTENSET_COMPARE0_Msk;
+  return prev;
+#endif
+}
+
+int WatchdogNRF::period() {
+  if (_extendMS)
+    return _extendMS;
+  return _wdto > 0 ? _wdto : 0;
+}
+
+void WatchdogNRF::restore(int prev) {
+  if (prev > 0)
+    extend(prev);
+}
 
 // There is no way to stop/disable watchdog using source code
 void WatchdogNRF::disable() {}
 
+WatchdogResetCause WatchdogNRF::resetReason() {
+#ifdef ARDUINO_NRF52_ADAFRUIT
+  // The core reads (and clears) RESETREAS at startup
+  uint32_t reas = readResetReason();
+#else
+  uint32_t reas = NRF_POWER->RESETREAS;
+#endif
+  if (reas & POWER_RESETREAS_DOG_Msk)
+    return WATCHDOG_RESET_WATCHDOG;
+  if (reas & POWER_RESETREAS_LOCKUP_Msk)
+    return WATCHDOG_RESET_FAULT;
+  if (reas & POWER_RESETREAS_SREQ_Msk)
+    return WATCHDOG_RESET_SOFTWARE;
+  if (reas & POWER_RESETREAS_OFF_Msk)
+    return WATCHDOG_RESET_WAKE;
+  if (reas & POWER_RESETREAS_RESETPIN_Msk)
+    return WATCHDOG_RESET_EXTERNAL;
+  // No bit set means power-on (or brownout, which looks the same)
+  return reas ? WATCHDOG_RESET_UNKNOWN : WATCHDOG_RESET_POWER_ON;
+}
+
+#if WATCHDOG_NRF_WDT_IRQ
+// Watchdog timeout interrupt.  Naked, so that the interrupted pc can be
+// found, it carries on in _watchdogNrfTimeout().
+WATCHDOG_CRUMBS_NAKED_ISR(WDT_IRQHandler, _watchdogNrfTimeout)
+
+void _watchdogNrfTimeout(uint32_t *frame) {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ISR);
+  WatchdogCrumbs::capture(frame[6]);
+  NRF_WDT->EVENTS_TIMEOUT = 0;
+}
+#endif
+
+#if !defined(ARDUINO_NRF52_ADAFRUIT) && WATCHDOG_NRF_RTC2
+// Sleep (System ON, only the low frequency clock running) until RTC2 has
+// counted ticks or a sleepUntil() pin fires.  Returns the ticks slept.
+static uint32_t _rtcSleep(uint32_t ticks) {
+  if (ticks < 2)
+    ticks = 2; // A compare one tick ahead can be missed
+  _rtcStart();
+  uint32_t start = NRF_RTC2->COUNTER;
+  NRF_RTC2->EVENTS_COMPARE[1] = 0;
+  NRF_RTC2->CC[1] = (start + ticks) & RTC_COUNTER_COUNTER_Msk;
+  NRF_RTC2->INTENSET = RTC_INTENSET_COMPARE1_Msk;
+
+  // With SEVONPEND, an interrupt that comes up while they are masked still
+  // wakes the WFE, so the compare (or a sleepUntil() pin) can't slip in
+  // between the check and the WFE.  SEV then WFE first clears any stale
+  // event, which would end the first WFE right away, before masking them so
+  // that it can't swallow the event of one that comes up in between.  Other
+  // interrupts wake the CPU briefly.
+  SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+  __SEV();
+  __WFE();
+  __disable_irq();
+  while ((NRF_RTC2->INTENSET & RTC_INTENSET_COMPARE1_Msk) &&
+         !NRF_RTC2->EVENTS_COMPARE[1] && !WatchdogWake::pending()) {
+    __WFE();
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
+  SCB->SCR &= ~SCB_SCR_SEVONPEND_Msk;
+
+  uint32_t slept = (NRF_RTC2->COUNTER - start) & RTC_COUNTER_COUNTER_Msk;
+  NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE1_Msk;
+  NRF_RTC2->EVENTS_COMPARE[1] = 0;
+  _rtcRelease();
+  return slept < ticks ? slept : ticks;
+}
+#endif
+
 int WatchdogNRF::sleep(int maxPeriodMS) {
   if (maxPeriodMS < 0)
     return 0;
 
-#ifdef ARDUINO_NRF52_ADAFRUIT
   // Mimic AVR to use 8 seconds.
   if (maxPeriodMS == 0)
     maxPeriodMS = 8000;
 
+#ifdef ARDUINO_NRF52_ADAFRUIT
   // Bluefruit freeRTOS tickless implementation will
   // automatically put CPU into low power mode with delay()
-  delay(maxPeriodMS);
+  WatchdogEnergy::sleepBegin();
+  if (!WatchdogWake::armed()) {
+    delay(maxPeriodMS);
+    WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, maxPeriodMS, false);
+    return maxPeriodMS;
+  }
 
-  return maxPeriodMS;
-#else
+  // A pin can't cut delay() short, so while sleepUntil() waits on pins
+  // sleep in short steps instead.
+  int slept = 0;
+  while (slept < maxPeriodMS && !WatchdogWake::pending()) {
+    int ms = maxPeriodMS - slept;
+    if (ms > WATCHDOG_NRF_WAKE_STEP_MS)
+      ms = WATCHDOG_NRF_WAKE_STEP_MS;
+    delay(ms);
+    slept += ms;
+  }
+  WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, slept, slept < maxPeriodMS);
+  return slept;
+#elif !WATCHDOG_NRF_RTC2
   return 0;
+#else
+  // Other cores: wait for RTC2 directly.  The watchdog keeps running in
+  // sleep (NRF_WDT_BEHAVIOUR_RUN_SLEEP), so it is fed every half period,
+  // and steps stay well short of the 24 bit counter wrapping.  millis()
+  // runs from RTC1 on these cores and keeps counting.
+  uint32_t stepMS = 256000;
+  if (_wdto > 0 && (uint32_t)_wdto / 2 < stepMS)
+    stepMS = _wdto > 1 ? _wdto / 2 : 1;
+  WatchdogEnergy::sleepBegin();
+  int slept = 0;
+  while (slept < maxPeriodMS) {
+    uint32_t ms = maxPeriodMS - slept;
+    if (ms > stepMS)
+      ms = stepMS;
+    uint32_t ticks = ((uint64_t)ms * 32768) / 1000;
+    uint32_t got = _rtcSleep(ticks);
+    if (_wdto > 0)
+      reset();
+    slept += got < ticks ? ((uint64_t)got * 1000) / 32768 : ms;
+    if (got < ticks)
+      break;
+  }
+  if (slept)
+    WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, slept, slept < maxPeriodMS);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
+  return slept;
 #endif
 }
 
@@ -1,10 +1,40 @@
 #ifndef WATCHDOGNRF_H_
 #define WATCHDOGNRF_H_
 
-class WatchdogNRF {
+#include <stdint.h>
+
+#include "WatchdogBase.h"
+
+// The library claims RTC2 (for extend(), and for sleep() on cores other than
+// Adafruit's) and the WDT interrupt (to note where the code was stuck, see
+// lastReset()), handlers included.  Build with -DWATCHDOG_NRF_RTC2=0 or
+// -DWATCHDOG_NRF_WDT_IRQ=0 to leave them to the sketch or another library:
+// extend() then changes nothing (and returns 0), sleep() on those cores
+// returns 0 right away, and lastReset() has no pc.
+#ifndef WATCHDOG_NRF_RTC2
+#define WATCHDOG_NRF_RTC2 1
+#endif
+#ifndef WATCHDOG_NRF_WDT_IRQ
+#define WATCHDOG_NRF_WDT_IRQ 1
+#endif
+
+class WatchdogNRF : public WatchdogBase<WatchdogNRF> {
 public:
   WatchdogNRF();
 
+  // Capabilities, for generic code to branch on at compile time (see
+  // WatchdogBase.h).
+  static constexpr bool canDisable = false;
+  static constexpr int32_t minPeriod = 1;
+  static constexpr int32_t maxPeriod = 2147483647;
+  static constexpr int32_t periodGranularity = 1;
+#if defined(ARDUINO_NRF52_ADAFRUIT) || WATCHDOG_NRF_RTC2
+  static constexpr bool supportsSleep = true;
+#else
+  static constexpr bool supportsSleep = false;
+#endif
+  static constexpr bool stateSurvivesWake = false;
+
   // Enable the watchdog timer to reset the machine after a period of time
   // without any calls to reset().  The passed in period (in milliseconds) is
   // just a suggestion and a lower value might be picked if the hardware does
@@ -17,19 +47,38 @@ public:
   // Reset or 'kick' the watchdog timer to prevent a reset of the device.
   void reset();
 
+  // Current timeout in milliseconds (extended or not), 0 when off.
+  int period();
+
+  // Lengthen the timeout for a while, for instance ahead of a long flash
+  // write.  The watchdog can't be reconfigured once started, so RTC2 feeds
+  // it instead until the new deadline, counted from now, is near.  Returns
+  // the previous timeout (0 if the watchdog is off, and then nothing
+  // changes) to hand back to restore() afterwards.  See WatchdogExtend for
+  // a guard that does both.
+  int extend(int maxPeriodMS);
+
+  // Go back to the timeout extend() returned, kicking the watchdog.
+  void restore(int prev);
+
   // Completely disable the watchdog timer.
   void disable()
       __attribute__((error("nRF's WDT cannot be disabled once enabled")));
 
-  // Enter the lowest power sleep mode (using the watchdog timer) for the
-  // desired period of time.  The passed in period (in milliseconds) is
-  // just a suggestion and a lower value might be picked if the hardware does
-  // not support the exact desired value
+  // Enter the lowest power sleep mode (System ON) for the desired period of
+  // time.  The passed in period (in milliseconds) is just a suggestion and a
+  // lower value might be picked if the hardware does not support the exact
+  // desired value.  The Adafruit core sleeps in its tickless delay(), other
+  // cores wait for RTC2 (compare 1) with WFE, feeding the watchdog every
+  // half period.
   //
   // The actual period (in milliseconds) that the hardware was asleep will be
   // returned.
   int sleep(int maxPeriodMS = 0);
 
+  // Find out the cause of the last reset.
+  WatchdogResetCause resetReason();
+
 private:
   int _wdto;
 };
@@ -0,0 +1,99 @@
+#include "WatchdogPersist.h"
+#include <string.h>
+
+#if defined(ARDUINO_ARCH_ESP8266)
+#include "Esp.h"
+
+// RAM doesn't survive a reset on the ESP8266, so the block lives in RTC
+// user memory instead.  The first 128 bytes (32 blocks) are left alone, they
+// are used by OTA updates.
+#define WATCHDOG_PERSIST_RTC_OFFSET 32
+
+static WatchdogPersistBlock _block;
+
+static bool _readBlock() {
+  return ESP.rtcUserMemoryRead(WATCHDOG_PERSIST_RTC_OFFSET,
+                               (uint32_t *)&_block, sizeof(_block));
+}
+
+static bool _writeBlock() {
+  return ESP.rtcUserMemoryWrite(WATCHDOG_PERSIST_RTC_OFFSET,
+                                (uint32_t *)&_block, sizeof(_block));
+}
+#else
+static WATCHDOG_NOINIT WatchdogPersistBlock _block;
+
+static bool _readBlock() { return true; }
+static bool _writeBlock() { return true; }
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Save a copy of the application state.
+    @param  state
+            State to save.
+    @param  len
+            Size of the state, up to WATCHDOG_STATE_SIZE bytes.
+    @return True on success, false if the state is too large.
+*/
+/**************************************************************************/
+bool WatchdogPersist::save(const void *state, uint16_t len) {
+  if (len > WATCHDOG_STATE_SIZE)
+    return false;
+  // Invalidate first, a reset halfway through must not leave a block that
+  // looks valid.
+  _block.magic = 0;
+  memcpy(_block.data, state, len);
+  _block.len = len;
+  _block.crc = crc16(_block.data, len);
+  _block.magic = WATCHDOG_PERSIST_MAGIC;
+  return _writeBlock();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Copy the saved application state back, if there is any.
+    @param  state
+            Where to copy the state to.
+    @param  len
+            Size of the state, must match what was saved.
+    @return True if a valid block of the right size was copied.
+*/
+/**************************************************************************/
+bool WatchdogPersist::load(void *state, uint16_t len) {
+  if (!_readBlock() || _block.magic != WATCHDOG_PERSIST_MAGIC ||
+      _block.len != len || _block.crc != crc16(_block.data, len))
+    return false;
+  memcpy(state, _block.data, len);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Throw the saved state away, the next load() fails.
+*/
+/**************************************************************************/
+void WatchdogPersist::clear() {
+  _block.magic = 0;
+  _writeBlock();
+}
+
+/**************************************************************************/
+/*!
+    @brief  CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF).
+    @param  data
+            Bytes to checksum.
+    @param  len
+            Number of bytes.
+    @return The checksum.
+*/
+/**************************************************************************/
+uint16_t WatchdogPersist::crc16(const uint8_t *data, uint16_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc ^= (uint16_t)*data++ << 8;
+    for (uint8_t i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
@@ -0,0 +1,58 @@
+/*!
+ * @file WatchdogPersist.h
+ *
+ * Checksummed block of application state that survives a watchdog reset,
+ * so a sketch can skip its expensive initialization on a warm restart.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGPERSIST_H_
+#define WATCHDOGPERSIST_H_
+
+#include <stdint.h>
+
+#include "WatchdogCrumbs.h"
+
+#ifndef WATCHDOG_STATE_SIZE
+#if defined(__AVR__)
+/** Largest block of state that can be saved, in bytes. */
+#define WATCHDOG_STATE_SIZE 32
+#else
+/** Largest block of state that can be saved, in bytes. */
+#define WATCHDOG_STATE_SIZE 128
+#endif
+#endif
+
+/** Block of state as laid out in retained memory. */
+typedef struct {
+  uint32_t magic; ///< WATCHDOG_PERSIST_MAGIC once saved
+  uint16_t len;   ///< Number of valid bytes in data[]
+  uint16_t crc;   ///< CRC-16/CCITT of data[0..len)
+  uint8_t data[(WATCHDOG_STATE_SIZE + 3) & ~3]; ///< Application state
+} WatchdogPersistBlock;
+
+/** Marks a WatchdogPersistBlock as valid. */
+#define WATCHDOG_PERSIST_MAGIC 0x57415354UL
+
+/**************************************************************************/
+/*!
+    @brief  Persistent state block shared by all backends: .noinit RAM,
+            uninitialized RAM on RP2040, RTC slow memory on ESP32 and RTC
+            user memory on ESP8266.  The backends only hand the state back
+            after a watchdog reset.
+*/
+/**************************************************************************/
+class WatchdogPersist {
+public:
+  static bool save(const void *state, uint16_t len);
+  static bool load(void *state, uint16_t len);
+  static void clear();
+  static uint16_t crc16(const uint8_t *data, uint16_t len);
+};
+
+#endif // WATCHDOGPERSIST_H_
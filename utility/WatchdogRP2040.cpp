@@ -1,6 +1,29 @@
 #if defined(ARDUINO_ARCH_RP2040)
 
 #include "WatchdogRP2040.h"
+#if !defined(PICO_RP2350)
+#include <hardware/clocks.h>
+#include <hardware/gpio.h>
+#include <hardware/pll.h>
+#include <hardware/structs/rosc.h>
+#include <hardware/structs/scb.h>
+#include <hardware/structs/vreg_and_chip_reset.h>
+#include <hardware/sync.h>
+#include <hardware/xosc.h>
+
+#ifndef XOSC_MHZ
+#define XOSC_MHZ 12
+#endif
+
+static volatile bool _alarmFired;
+
+static int64_t _wakeAlarm(alarm_id_t id, void *user_data) {
+  (void)id;
+  (void)user_data;
+  _alarmFired = true;
+  return 0; // Don't reschedule
+}
+#endif
 
 /**********************************************************************************************/
 /*!
@@ -18,7 +41,9 @@ int WatchdogRP2040::enable(int maxPeriodMS) {
   // Enables the RP2040's hardware WDT with maxPeriodMS delay
   // (wdt should be updated every maxPeriodMS ms) and
   // enables pausing the WDT on debugging when stepping thru
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
   watchdog_enable(maxPeriodMS, 1);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
 
   _wdto = maxPeriodMS;
   return maxPeriodMS;
@@ -30,7 +55,48 @@ int WatchdogRP2040::enable(int maxPeriodMS) {
             enable().
 */
 /**************************************************************************/
-void WatchdogRP2040::reset() { watchdog_update(); }
+void WatchdogRP2040::reset() {
+  watchdog_update();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Changes the timeout of the running watchdog (and kicks it), for
+            instance ahead of a long flash write.  See WatchdogExtend for a
+            guard that restores it afterwards.
+    @param    maxPeriodMS
+              New timeout, in milliseconds, up to 8388.
+    @return The previous timeout to hand back to restore(), 0 if the
+            watchdog is off (and then nothing changes).
+*/
+/**************************************************************************/
+int WatchdogRP2040::extend(int maxPeriodMS) {
+  int prev = _wdto > 0 ? _wdto : 0;
+  if (prev && maxPeriodMS > 0) {
+    // The hardware counter is 24 bits, counting twice per us (RP2040-E1)
+    if (maxPeriodMS > 8388)
+      maxPeriodMS = 8388;
+    watchdog_enable(maxPeriodMS, 1);
+    _wdto = maxPeriodMS;
+  }
+  return prev;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Goes back to the timeout extend() returned, kicking the
+            watchdog.
+    @param    prev
+              Value returned by extend().
+*/
+/**************************************************************************/
+void WatchdogRP2040::restore(int prev) {
+  if (prev > 0) {
+    watchdog_enable(prev, 1);
+    _wdto = prev;
+  }
+}
 
 /**************************************************************************/
 /*!
@@ -41,8 +107,40 @@ void WatchdogRP2040::disable() {}
 
 /**************************************************************************/
 /*!
-    @brief  Configures the RP2040 to enter a lower power (WFE) sleep
-            for a period of time.
+    @brief  Decodes the cause of the last reset.
+    @return The cause of the last reset.
+*/
+/**************************************************************************/
+WatchdogResetCause WatchdogRP2040::resetReason() {
+  // Only a reset from watchdog_enable() counts as a timeout, anything else
+  // (watchdog_reboot(), rp2040.reboot()...) was asked for
+  if (watchdog_enable_caused_reboot())
+    return WATCHDOG_RESET_WATCHDOG;
+  if (watchdog_caused_reboot())
+    return WATCHDOG_RESET_SOFTWARE;
+#if !defined(PICO_RP2350)
+  uint32_t chip = vreg_and_chip_reset_hw->chip_reset;
+  if (chip & VREG_AND_CHIP_RESET_CHIP_RESET_HAD_RUN_BITS)
+    return WATCHDOG_RESET_EXTERNAL;
+  if (chip & VREG_AND_CHIP_RESET_CHIP_RESET_HAD_PSM_RESTART_BITS)
+    return WATCHDOG_RESET_SOFTWARE; // debugger
+  if (chip & VREG_AND_CHIP_RESET_CHIP_RESET_HAD_POR_BITS)
+    return WATCHDOG_RESET_POWER_ON;
+#endif
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Configures the RP2040 to enter a low power sleep for a period
+            of time: the core goes into deep sleep (WFI with SLEEPDEEP) with
+            every clock gated except the ones the system timer needs to
+            wake it back up.  Peripherals (USB included) stop until it
+            wakes, and the watchdog is paused meanwhile so it can't bite
+            during a long sleep; it comes back with the period set in
+            enable().  Any other interrupt wakes the core only briefly,
+            unless it is a sleepUntil() pin.
+            On RP2350 this is a plain sleep_ms().
     @param    maxPeriodMS
               Time to sleep the RP2040, in millis.
     @return The actual period (in milliseconds) that the hardware was
@@ -51,13 +149,153 @@ void WatchdogRP2040::disable() {}
 */
 /**************************************************************************/
 int WatchdogRP2040::sleep(int maxPeriodMS) {
-  if (maxPeriodMS < 0)
+  if (maxPeriodMS <= 0)
     return 0;
 
-  // perform a lower power (WFE) sleep (pico-core calls sleep_ms(sleepTime))
+#if defined(PICO_RP2350)
+  // perform a lower power (WFE) sleep (pico-core calls sleep_ms(sleepTime)),
+  // a millisecond at a time while sleepUntil() waits on pins
+  WatchdogEnergy::sleepBegin();
+  if (WatchdogWake::armed()) {
+    int slept = 0;
+    while (slept < maxPeriodMS && !WatchdogWake::pending()) {
+      sleep_ms(1);
+      slept++;
+    }
+    WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, slept, slept < maxPeriodMS);
+    return slept;
+  }
   sleep_ms(maxPeriodMS);
-
+  WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, maxPeriodMS, false);
   return maxPeriodMS;
+#else
+  uint64_t start = time_us_64();
+  _alarmFired = false;
+  alarm_id_t alarm =
+      add_alarm_in_us((uint64_t)maxPeriodMS * 1000, _wakeAlarm, NULL, false);
+  if (alarm <= 0)
+    return 0; // No free alarm
+  WatchdogEnergy::sleepBegin();
+
+  _pauseWatchdog();
+  // Only keep the timer (and the watchdog block, which generates its tick)
+  // clocked while the core is in deep sleep, plus the GPIO block if
+  // sleepUntil() waits on pins
+  uint32_t en0 = clocks_hw->sleep_en0;
+  uint32_t en1 = clocks_hw->sleep_en1;
+  clocks_hw->sleep_en0 =
+      WatchdogWake::armed() ? CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS : 0;
+  clocks_hw->sleep_en1 = CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS |
+                         CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS;
+  scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+
+  // WFI still wakes on a pending interrupt with them masked, so the alarm
+  // (or a sleepUntil() pin) can't slip in between the check and the WFI
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+  uint32_t irq = save_and_disable_interrupts();
+  while (!_alarmFired && !WatchdogWake::pending()) {
+    __wfi();
+    restore_interrupts(irq);
+    irq = save_and_disable_interrupts();
+  }
+  restore_interrupts(irq);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
+
+  scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+  clocks_hw->sleep_en0 = en0;
+  clocks_hw->sleep_en1 = en1;
+  _resumeWatchdog();
+  if (!_alarmFired)
+    cancel_alarm(alarm);
+
+  // The timer ran all along, so millis() is still right as well
+  int slept = (int)((time_us_64() - start) / 1000);
+  WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_STOP, slept, !_alarmFired);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
+  return slept;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Puts the RP2040 in dormant mode, the lowest power state: the
+            crystal and every clock (the system timer and watchdog too)
+            stop until the pin goes to the given level.  The clocks are
+            brought back up at F_CPU on wake, but USB has to re-enumerate,
+            and millis() doesn't count the time spent dormant.
+    @param    pin
+              GPIO to wake on.
+    @param    high
+              Wake on a rising (true) or falling (false) edge.
+    @return True once woken up, false on RP2350 (not supported).
+*/
+/**************************************************************************/
+bool WatchdogRP2040::dormantUntilPin(uint8_t pin, bool high) {
+#if defined(PICO_RP2350)
+  (void)pin;
+  (void)high;
+  return false;
+#else
+  // Run everything straight from the crystal, so the PLLs and the ring
+  // oscillator can be stopped
+  clock_configure(clk_ref, CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC, 0,
+                  XOSC_MHZ * MHZ, XOSC_MHZ * MHZ);
+  clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0,
+                  XOSC_MHZ * MHZ, XOSC_MHZ * MHZ);
+  clock_stop(clk_usb);
+  clock_stop(clk_adc);
+  clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC,
+                  XOSC_MHZ * MHZ, 46875);
+  clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+                  XOSC_MHZ * MHZ, XOSC_MHZ * MHZ);
+  pll_deinit(pll_sys);
+  pll_deinit(pll_usb);
+  hw_write_masked(&rosc_hw->ctrl,
+                  ROSC_CTRL_ENABLE_VALUE_DISABLE << ROSC_CTRL_ENABLE_LSB,
+                  ROSC_CTRL_ENABLE_BITS);
+
+  uint32_t event = high ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+  gpio_set_dormant_irq_enabled(pin, event, true);
+  xosc_dormant(); // Returns once the pin woke the crystal back up
+  gpio_acknowledge_irq(pin, event);
+  gpio_set_dormant_irq_enabled(pin, event, false);
+
+  // Same clock tree as at boot: USB, ADC and RTC from a 48MHz USB PLL, the
+  // system clock back at F_CPU (set_sys_clock_khz() moves clk_peri too)
+  hw_write_masked(&rosc_hw->ctrl,
+                  ROSC_CTRL_ENABLE_VALUE_ENABLE << ROSC_CTRL_ENABLE_LSB,
+                  ROSC_CTRL_ENABLE_BITS);
+  pll_init(pll_usb, 1, 1200 * MHZ, 5, 5);
+  clock_configure(clk_usb, 0, CLOCKS_CLK_USB_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+                  48 * MHZ, 48 * MHZ);
+  clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+                  48 * MHZ, 48 * MHZ);
+  clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+                  48 * MHZ, 46875);
+  set_sys_clock_khz(F_CPU / 1000, true);
+  return true;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stops the watchdog from counting down, without forgetting the
+            period set in enable().
+*/
+/**************************************************************************/
+void WatchdogRP2040::_pauseWatchdog() {
+  hw_clear_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_ENABLE_BITS);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Starts the watchdog again with a full period, if it was
+            enabled.
+*/
+/**************************************************************************/
+void WatchdogRP2040::_resumeWatchdog() {
+  if (_wdto > 0)
+    watchdog_enable(_wdto, 1);
 }
 
 #endif // ARDUINO_ARCH_RP2040
@@ -18,22 +18,46 @@
 #include <hardware/watchdog.h>
 #include <pico/time.h>
 
+#include "WatchdogBase.h"
+
 /**************************************************************************/
 /*!
     @brief  Class that contains functions for interacting with the
             RP2040's hardware watchdog timer
 */
 /**************************************************************************/
-class WatchdogRP2040 {
+class WatchdogRP2040 : public WatchdogBase<WatchdogRP2040> {
 public:
   WatchdogRP2040() : _wdto(-1){};
+
+  /// Capabilities, for generic code to branch on at compile time (see
+  /// WatchdogBase.h).
+  static constexpr bool canDisable = false;
+  static constexpr int32_t minPeriod = 1;
+  static constexpr int32_t maxPeriod = 8388;
+  static constexpr int32_t periodGranularity = 1;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
+
   int enable(int maxPeriodMS = 0);
   void disable()
       __attribute__((error("RP2040 WDT cannot be disabled once enabled")));
   void reset();
+  /*!
+      @brief  Tells the current timeout (extended or not).
+      @return The timeout in milliseconds, 0 when off.
+  */
+  int period() { return _wdto > 0 ? _wdto : 0; }
+  int extend(int maxPeriodMS);
+  void restore(int prev);
   int sleep(int maxPeriodMS = 0);
+  bool dormantUntilPin(uint8_t pin, bool high);
+  WatchdogResetCause resetReason();
 
 private:
+  void _pauseWatchdog();
+  void _resumeWatchdog();
+
   int _wdto;
 };
 
@@ -8,7 +8,52 @@
 #include "WatchdogSAMD.h"
 #include <sam.h>
 
+// Wait for writes to the WDT to make it across to its slow clock domain,
+// which takes a few cycles of that clock.
+static inline void wdt_sync() {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SYNC_BEGIN);
+#if defined(__SAMD51__)
+  while (WDT->SYNCBUSY.reg)
+    ;
+#else
+  while (WDT->STATUS.bit.SYNCBUSY)
+    ;
+#endif
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SYNC_END);
+}
+
+// Period, window and early warning offset encoding for a time in
+// milliseconds: 8 << bits WDT cycles, the largest power of two that fits
+// (16384 cycles, about 16 seconds, for 0).
+static uint8_t wdt_bits(int ms) {
+  if ((ms >= 16000) || !ms)
+    return 0xB;
+  long cycles = (ms * 1024L + 500) / 1000; // ms -> WDT cycles
+  uint8_t bits = 0;
+  while (bits < 0xA && cycles >= (16L << bits))
+    bits++;
+  return bits;
+}
+
 int WatchdogSAMD::enable(int maxPeriodMS, bool isForSleep) {
+  if (!isForSleep)
+    _closedMS = 0;
+  return _configure(maxPeriodMS, isForSleep);
+}
+
+int WatchdogSAMD::enableWindow(int closedMS, int openMS) {
+  _closedMS = closedMS > 0 ? closedMS : 0;
+  int actualMS = _configure(openMS, false);
+  if (_closedMS)
+    actualMS += ((8L << wdt_bits(_closedMS)) * 1000 + 512) / 1024;
+  return actualMS;
+}
+
+void WatchdogSAMD::setEarlyWarning(int offsetMS) {
+  _warningMS = offsetMS > 0 ? offsetMS : 0;
+}
+
+int WatchdogSAMD::_configure(int maxPeriodMS, bool isForSleep) {
   // Enable the watchdog with a period up to the specified max period in
   // milliseconds.
 
@@ -18,17 +63,16 @@ int WatchdogSAMD::enable(int maxPeriodMS, bool isForSleep) {
   int cycles;
   uint8_t bits;
 
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
   if (!_initialized)
     _initialize_wdt();
 
 #if defined(__SAMD51__)
   WDT->CTRLA.reg = 0; // Disable watchdog for config
-  while (WDT->SYNCBUSY.reg)
-    ;
+  wdt_sync();
 #else
   WDT->CTRL.reg = 0; // Disable watchdog for config
-  while (WDT->STATUS.bit.SYNCBUSY)
-    ;
+  wdt_sync();
 #endif
 
   // You'll see some occasional conversion here compensating between
@@ -36,46 +80,8 @@ int WatchdogSAMD::enable(int maxPeriodMS, bool isForSleep) {
   // power oscillator used by the WDT ostensibly runs at 32,768 Hz with
   // a 1:32 prescale, thus 1024 Hz, though probably not super precise.
 
-  if ((maxPeriodMS >= 16000) || !maxPeriodMS) {
-    cycles = 16384;
-    bits = 0xB;
-  } else {
-    cycles = (maxPeriodMS * 1024L + 500) / 1000; // ms -> WDT cycles
-    if (cycles >= 8192) {
-      cycles = 8192;
-      bits = 0xA;
-    } else if (cycles >= 4096) {
-      cycles = 4096;
-      bits = 0x9;
-    } else if (cycles >= 2048) {
-      cycles = 2048;
-      bits = 0x8;
-    } else if (cycles >= 1024) {
-      cycles = 1024;
-      bits = 0x7;
-    } else if (cycles >= 512) {
-      cycles = 512;
-      bits = 0x6;
-    } else if (cycles >= 256) {
-      cycles = 256;
-      bits = 0x5;
-    } else if (cycles >= 128) {
-      cycles = 128;
-      bits = 0x4;
-    } else if (cycles >= 64) {
-      cycles = 64;
-      bits = 0x3;
-    } else if (cycles >= 32) {
-      cycles = 32;
-      bits = 0x2;
-    } else if (cycles >= 16) {
-      cycles = 16;
-      bits = 0x1;
-    } else {
-      cycles = 8;
-      bits = 0x0;
-    }
-  }
+  bits = wdt_bits(maxPeriodMS);
+  cycles = 8 << bits;
 
   // Watchdog timer on SAMD is a slightly different animal than on AVR.
   // On AVR, the WTD timeout is configured in one register and then an
@@ -99,6 +105,33 @@ int WatchdogSAMD::enable(int maxPeriodMS, bool isForSleep) {
   // function (later in this file) explicitly passes 'true' to get the
   // alternate behavior.
 
+  // Outside of sleep the early warning interrupt is still used, but only to
+  // note where the code was stuck right before a watchdog reset (see
+  // lastReset()).  The offset uses the same encoding as the period and has
+  // to be shorter, so it fires halfway through; firing when the sketch does
+  // kick in the second half is harmless, the next warning overwrites it.
+  // setEarlyWarning() moves it, still short of the period.  With a
+  // recovery callback the early warning is the (first) timeout instead, so
+  // it goes where the period would be and the period for chip reset is
+  // doubled.  In window mode the early warning fires as the open window
+  // starts, whatever EWOFFSET says, so on every healthy cycle: it can't
+  // tell a stuck sketch from one about to kick, and stays off (offset and
+  // recovery callback included).
+  int ewBits = bits - 1;
+  if (_warningMS && wdt_bits(_warningMS) < ewBits)
+    ewBits = wdt_bits(_warningMS);
+  if (_closedMS && !isForSleep) {
+    ewBits = -1;
+  } else if (_recovery && !isForSleep) {
+    if (bits == 0xB) {
+      cycles = 8192;
+      bits = 0xA;
+    }
+    ewBits = bits++;
+  }
+  _sleeping = isForSleep;
+  _escalated = false;
+
 #if defined(__SAMD51__)
   if (isForSleep) {
     WDT->INTFLAG.bit.EW = 1;        // Clear interrupt flag
@@ -107,56 +140,89 @@ int WatchdogSAMD::enable(int maxPeriodMS, bool isForSleep) {
     WDT->CONFIG.bit.WINDOW = bits;  // Set time of interrupt
     WDT->EWCTRL.bit.EWOFFSET = 0x0; // Early warning offset
     WDT->CTRLA.bit.WEN = 1;         // Enable window mode
-    while (WDT->SYNCBUSY.reg)
-      ; // Sync CTRL write
+    wdt_sync(); // Sync CTRL write
   } else {
-    WDT->INTENCLR.bit.EW = 1;   // Disable early warning interrupt
+    WDT->INTFLAG.bit.EW = 1; // Clear interrupt flag
+    if (ewBits >= 0) {
+      WDT->EWCTRL.bit.EWOFFSET = ewBits; // Set time of interrupt
+      WDT->INTENSET.bit.EW = 1;          // Enable early warning interrupt
+    } else {
+      WDT->INTENCLR.bit.EW = 1; // Disable early warning interrupt
+    }
     WDT->CONFIG.bit.PER = bits; // Set period for chip reset
-    WDT->CTRLA.bit.WEN = 0;     // Disable window mode
-    while (WDT->SYNCBUSY.reg)
-      ; // Sync CTRL write
+    if (_closedMS) {
+      // Kicks before the open window reset the chip
+      WDT->CONFIG.bit.WINDOW = wdt_bits(_closedMS);
+      WDT->CTRLA.bit.WEN = 1; // Enable window mode
+    } else {
+      WDT->CTRLA.bit.WEN = 0; // Disable window mode
+    }
+    wdt_sync(); // Sync CTRL write
   }
 
   reset();                   // Clear watchdog interval
   WDT->CTRLA.bit.ENABLE = 1; // Start watchdog now!
-  while (WDT->SYNCBUSY.reg)
-    ;
+  wdt_sync();
 #else
   if (isForSleep) {
     WDT->INTENSET.bit.EW = 1;      // Enable early warning interrupt
     WDT->CONFIG.bit.PER = 0xB;     // Period = max
     WDT->CONFIG.bit.WINDOW = bits; // Set time of interrupt
     WDT->CTRL.bit.WEN = 1;         // Enable window mode
-    while (WDT->STATUS.bit.SYNCBUSY)
-      ; // Sync CTRL write
+    wdt_sync(); // Sync CTRL write
   } else {
-    WDT->INTENCLR.bit.EW = 1;   // Disable early warning interrupt
+    WDT->INTFLAG.bit.EW = 1; // Clear interrupt flag
+    if (ewBits >= 0) {
+      WDT->EWCTRL.bit.EWOFFSET = ewBits; // Set time of interrupt
+      WDT->INTENSET.bit.EW = 1;          // Enable early warning interrupt
+    } else {
+      WDT->INTENCLR.bit.EW = 1; // Disable early warning interrupt
+    }
     WDT->CONFIG.bit.PER = bits; // Set period for chip reset
-    WDT->CTRL.bit.WEN = 0;      // Disable window mode
-    while (WDT->STATUS.bit.SYNCBUSY)
-      ; // Sync CTRL write
+    if (_closedMS) {
+      // Kicks before the open window reset the chip
+      WDT->CONFIG.bit.WINDOW = wdt_bits(_closedMS);
+      WDT->CTRL.bit.WEN = 1; // Enable window mode
+    } else {
+      WDT->CTRL.bit.WEN = 0; // Disable window mode
+    }
+    wdt_sync(); // Sync CTRL write
   }
 
   reset();                  // Clear watchdog interval
   WDT->CTRL.bit.ENABLE = 1; // Start watchdog now!
-  while (WDT->STATUS.bit.SYNCBUSY)
-    ;
+  wdt_sync();
 #endif
 
-  return (cycles * 1000L + 512) / 1024; // WDT cycles -> ms
+  int actualMS = (cycles * 1000L + 512) / 1024; // WDT cycles -> ms
+  _periodMS = isForSleep ? 0 : actualMS;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
+  return actualMS;
+}
+
+int WatchdogSAMD::extend(int maxPeriodMS) {
+  int prev = _periodMS;
+  // Reprogramming goes through a few slow clock synchronizations (a few ms)
+  // and kicks it.  It keeps the closed window, if any.
+  if (prev)
+    _configure(maxPeriodMS, false);
+  return prev;
+}
+
+void WatchdogSAMD::restore(int prev) {
+  if (prev)
+    _configure(prev, false);
 }
 
 void WatchdogSAMD::reset() {
   // Write the watchdog clear key value (0xA5) to the watchdog
   // clear register to clear the watchdog timer and reset it.
-#if defined(__SAMD51__)
-  while (WDT->SYNCBUSY.reg)
-    ;
-#else
-  while (WDT->STATUS.bit.SYNCBUSY)
-    ;
-#endif
+  wdt_sync();
   WDT->CLEAR.reg = WDT_CLEAR_CLEAR_KEY;
+  if (_closedMS)
+    _kickMS = millis();
+  _escalated = false;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
 }
 
 uint8_t WatchdogSAMD::resetCause() {
@@ -167,28 +233,93 @@ uint8_t WatchdogSAMD::resetCause() {
 #endif
 }
 
+WatchdogResetCause WatchdogSAMD::resetReason() {
+  uint8_t cause = resetCause();
+#if defined(__SAMD51__)
+  if (cause & RSTC_RCAUSE_WDT)
+    return WATCHDOG_RESET_WATCHDOG;
+  if (cause & RSTC_RCAUSE_SYST)
+    return WATCHDOG_RESET_SOFTWARE;
+  if (cause & (RSTC_RCAUSE_BODCORE | RSTC_RCAUSE_BODVDD))
+    return WATCHDOG_RESET_BROWNOUT;
+  if (cause & RSTC_RCAUSE_EXT)
+    return WATCHDOG_RESET_EXTERNAL;
+  if (cause & RSTC_RCAUSE_BACKUP)
+    return WATCHDOG_RESET_WAKE;
+  if (cause & RSTC_RCAUSE_POR)
+    return WATCHDOG_RESET_POWER_ON;
+#else
+  if (cause & PM_RCAUSE_WDT)
+    return WATCHDOG_RESET_WATCHDOG;
+  if (cause & PM_RCAUSE_SYST)
+    return WATCHDOG_RESET_SOFTWARE;
+  if (cause & (PM_RCAUSE_BOD12 | PM_RCAUSE_BOD33))
+    return WATCHDOG_RESET_BROWNOUT;
+  if (cause & PM_RCAUSE_EXT)
+    return WATCHDOG_RESET_EXTERNAL;
+  if (cause & PM_RCAUSE_POR)
+    return WATCHDOG_RESET_POWER_ON;
+#endif
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+void WatchdogSAMD::setRecoveryCallback(void (*callback)(void)) {
+  _recovery = callback;
+}
+
 void WatchdogSAMD::disable() {
 #if defined(__SAMD51__)
   WDT->CTRLA.bit.ENABLE = 0;
-  while (WDT->SYNCBUSY.reg)
-    ;
+  wdt_sync();
 #else
   WDT->CTRL.bit.ENABLE = 0;
-  while (WDT->STATUS.bit.SYNCBUSY)
-    ;
+  wdt_sync();
 #endif
+  _periodMS = 0;
+}
+
+bool WatchdogSAMD::_sleeping = false;
+void (*volatile WatchdogSAMD::_recovery)(void) = NULL;
+volatile bool WatchdogSAMD::_escalated = false;
+
+// ISR for watchdog early warning, DO NOT RENAME!  Naked, so that the
+// interrupted pc can be found, it carries on in _earlyWarning().
+WATCHDOG_CRUMBS_NAKED_ISR(WDT_Handler, _watchdogSamdEarlyWarning)
+
+void _watchdogSamdEarlyWarning(uint32_t *frame) {
+  WatchdogSAMD::_earlyWarning(frame);
 }
 
-void WDT_Handler(void) {
-  // ISR for watchdog early warning, DO NOT RENAME!
+void WatchdogSAMD::_earlyWarning(uint32_t *frame) {
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ISR);
+  if (!_sleeping) {
+    // Stacked r0-r3, r12, lr, pc, xpsr: note the interrupted pc.
+    WatchdogCrumbs::capture(frame[6]);
+    WDT->INTFLAG.bit.EW = 1; // Clear interrupt flag
+    if (_recovery) {
+      if (_escalated) {
+        // Second timeout in a row: any value but the key resets right away
+        WDT->CLEAR.reg = 0;
+        while (1)
+          ;
+      }
+      // First timeout: start a new period, then try to recover
+      _escalated = true;
+      wdt_sync();
+      WDT->CLEAR.reg = WDT_CLEAR_CLEAR_KEY;
+      _recovery();
+    }
+    // Otherwise let the watchdog run on, a reset follows unless the sketch
+    // kicks it.
+    return;
+  }
+
 #if defined(__SAMD51__)
   WDT->CTRLA.bit.ENABLE = 0; // Disable watchdog
-  while (WDT->SYNCBUSY.reg)
-    ;
+  wdt_sync();
 #else
   WDT->CTRL.bit.ENABLE = 0; // Disable watchdog
-  while (WDT->STATUS.bit.SYNCBUSY)
-    ; // Sync CTRL write
+  wdt_sync(); // Sync CTRL write
 #endif
   WDT->INTFLAG.bit.EW = 1; // Clear interrupt flag
 }
@@ -196,6 +327,7 @@ void WDT_Handler(void) {
 int WatchdogSAMD::sleep(int maxPeriodMS) {
 
   int actualPeriodMS = enable(maxPeriodMS, true); // true = for sleep
+  WatchdogEnergy::sleepBegin();
 
   // Enable standby sleep mode (deepest sleep) and activate.
   // Insights from Atmel ASF library.
@@ -216,13 +348,38 @@ int WatchdogSAMD::sleep(int maxPeriodMS) {
   SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk; // Disable SysTick interrupts
 #endif
 
-  __DSB(); // Data sync to ensure outgoing memory accesses complete
-  __WFI(); // Wait for interrupt (places device in sleep mode)
+  // WFI still wakes on a pending interrupt with them masked, so a
+  // sleepUntil() pin can't fire between the check and the WFI unnoticed.
+  __disable_irq();
+  if (!WatchdogWake::pending()) {
+    WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+    __DSB(); // Data sync to ensure outgoing memory accesses complete
+    __WFI(); // Wait for interrupt (places device in sleep mode)
+    WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
+  }
+  __enable_irq();
 
 #if (SAMD20_SERIES || SAMD21_SERIES)
   SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk; // Enable SysTick interrupts
 #endif
 
+  // Woken up by something else than the early warning (a sleepUntil() pin,
+  // say): stop the watchdog like the early warning would have, kicking it
+  // in its closed window would reset the chip.
+#if defined(__SAMD51__)
+  if (WDT->CTRLA.bit.ENABLE) {
+    WDT->CTRLA.bit.ENABLE = 0;
+    wdt_sync();
+    WDT->INTFLAG.bit.EW = 1;
+  }
+#else
+  if (WDT->CTRL.bit.ENABLE) {
+    WDT->CTRL.bit.ENABLE = 0;
+    wdt_sync();
+    WDT->INTFLAG.bit.EW = 1;
+  }
+#endif
+
   // Code resumes here on wake (WDT early warning interrupt).
   // Bug: the return value assumes the WDT has run its course;
   // incorrect if the device woke due to an external interrupt.
@@ -231,12 +388,16 @@ int WatchdogSAMD::sleep(int maxPeriodMS) {
   // might indicate said condition occurred by returning 0 instead
   // (assuming we can pin down which interrupt caused the wake).
 
+  WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_STOP, actualPeriodMS,
+                           WatchdogWake::pending());
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
   return actualPeriodMS;
 }
 
 void WatchdogSAMD::_initialize_wdt() {
   // One-time initialization of watchdog timer.
   // Insights from rickrlh and rbrucemtl in Arduino forum!
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_INIT_BEGIN);
 
 #if defined(__SAMD51__)
   // SAMD51 WDT uses OSCULP32k as input clock now
@@ -250,8 +411,7 @@ void WatchdogSAMD::_initialize_wdt() {
   NVIC_SetPriority(WDT_IRQn, 0); // Top priority
   NVIC_EnableIRQ(WDT_IRQn);
 
-  while (WDT->SYNCBUSY.reg)
-    ;
+  wdt_sync();
 
   USB->DEVICE.CTRLA.bit.ENABLE = 0; // Disable the USB peripheral
   while (USB->DEVICE.SYNCBUSY.bit.ENABLE)
@@ -281,6 +441,7 @@ void WatchdogSAMD::_initialize_wdt() {
 #endif
 
   _initialized = true;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_INIT_END);
 }
 
 #endif // defined(ARDUINO_ARCH_SAMD)
@@ -3,9 +3,22 @@
 
 #include <Arduino.h>
 
-class WatchdogSAMD {
+#include "WatchdogBase.h"
+
+class WatchdogSAMD : public WatchdogBase<WatchdogSAMD> {
 public:
-  WatchdogSAMD() : _initialized(false) {}
+  WatchdogSAMD()
+      : _initialized(false), _periodMS(0), _closedMS(0), _warningMS(0),
+        _kickMS(0) {}
+
+  // Capabilities, for generic code to branch on at compile time (see
+  // WatchdogBase.h).
+  static constexpr bool canDisable = true;
+  static constexpr int32_t minPeriod = 8;
+  static constexpr int32_t maxPeriod = 16000;
+  static constexpr int32_t periodGranularity = 0;
+  static constexpr bool supportsSleep = true;
+  static constexpr bool stateSurvivesWake = false;
 
   // Enable the watchdog timer to reset the machine after a period of time
   // without any calls to reset().  The passed in period (in milliseconds)
@@ -16,15 +29,72 @@ public:
   // out when calling enable(), just let the default have its way.
   //
   // The actual period (in milliseconds) before a watchdog timer reset is
-  // returned.
+  // returned.  Halfway through, the early warning interrupt notes where the
+  // code is (see lastReset()) in case the reset does happen.
   int enable(int maxPeriodMS = 0, bool isForSleep = false);
 
+  // Enable the watchdog timer in window mode, to catch code that kicks too
+  // often (a runaway loop) as well as not often enough: for closedMS after
+  // each kick, kicking again resets the machine right away, then kicks are
+  // accepted for openMS, after which the machine resets as usual.  Both are
+  // rounded down like enable()'s period, 0 for closedMS is plain enable().
+  // resetIfDue() holds kicks back until the closed window is over.
+  //
+  // The actual time (in milliseconds) from a kick to a watchdog timer reset,
+  // closed and open windows together, is returned.  The hardware fires the
+  // early warning as every open window starts, so it is left off in window
+  // mode: no pc in lastReset(), and no setEarlyWarning() or recovery
+  // callback.  extend() and restore() change the open window and keep the
+  // closed one, until the next enable().
+  int enableWindow(int closedMS, int openMS);
+
+  // resetIfDue() hook: in window mode, only once the closed window since
+  // the last kick (plus the few WDT clock cycles the kick takes to get
+  // through clock domain synchronization) is over.
+  bool kickAllowed(uint32_t now) {
+    return !_closedMS || now - _kickMS > (uint32_t)_closedMS + 4;
+  }
+
+  // Move the early warning interrupt, which notes where the code is (see
+  // lastReset()), to offsetMS into the period, rounded down to what the
+  // hardware can do and kept short of the reset.  Firing early catches
+  // the code closer to where it got stuck, but also more often when it
+  // isn't.  0 goes back to halfway.  Takes effect on the next enable(), and
+  // is left out with a recovery callback, whose first timeout it is, and in
+  // window mode.
+  void setEarlyWarning(int offsetMS);
+
   // Reset or 'kick' the watchdog timer to prevent a reset of the device.
   void reset();
 
+  // Current timeout in milliseconds (extended or not, the open window in
+  // window mode), 0 when off.
+  int period() { return _periodMS; }
+
+  // Two-stage escalation: the first timeout calls 'callback' (from the
+  // early warning interrupt, so keep it short) to try and recover, e.g. by
+  // resetting a stuck peripheral, and only a second timeout in a row
+  // resets the device.  Takes effect on the next enable(), which then
+  // returns the period until the first timeout (8 seconds at most).
+  // Pass NULL to go back to resetting straight away.
+  void setRecoveryCallback(void (*callback)(void));
+
   // Find out the cause of the last reset - see datasheet for bitmask
   uint8_t resetCause();
 
+  // Find out the cause of the last reset, decoded.
+  WatchdogResetCause resetReason();
+
+  // Change the timeout of the running watchdog (and kick it), up to 16
+  // seconds, for instance ahead of a long flash write.  Returns the
+  // previous timeout (0 if the watchdog is off, and then nothing changes)
+  // to hand back to restore() afterwards.  See WatchdogExtend for a guard
+  // that does both.
+  int extend(int maxPeriodMS);
+
+  // Go back to the timeout extend() returned, kicking the watchdog.
+  void restore(int prev);
+
   // Completely disable the watchdog timer.
   void disable();
 
@@ -37,10 +107,34 @@ public:
   // returned.
   int sleep(int maxPeriodMS = 0);
 
+  // Early warning interrupt body, used internally by the library.
+  static void _earlyWarning(uint32_t *frame);
+
 private:
   void _initialize_wdt();
+  int _configure(int maxPeriodMS, bool isForSleep);
+
+  // Whether the early warning is there to wake from sleep() (rather than
+  // to note where the code was stuck before a reset).
+  static bool _sleeping;
+
+  // Soft recovery callback, and whether it already ran since the last
+  // reset().
+  static void (*volatile _recovery)(void);
+  static volatile bool _escalated;
 
   bool _initialized;
+
+  // Period set by enable() (outside of sleep), in milliseconds, 0 when off.
+  int _periodMS;
+
+  // Closed window set by enableWindow(), 0 outside of window mode, and
+  // early warning offset set by setEarlyWarning(), 0 for halfway.
+  int _closedMS;
+  int _warningMS;
+
+  // millis() of the last kick, kept in window mode only.
+  uint32_t _kickMS;
 };
 
 #endif
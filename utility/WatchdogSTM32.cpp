@@ -0,0 +1,320 @@
+#if defined(ARDUINO_ARCH_STM32)
+
+#include "WatchdogSTM32.h"
+
+// Reset flags as they were at boot, before they were cleared for the next
+// reset to set its own (they are sticky, a stale watchdog flag would hide
+// every later cause).  resetFlags() hands them to the sketch, in place of
+// IWatchdog.isReset() which then no longer sees them.
+static uint32_t _resetFlags;
+
+static struct WatchdogSTM32Boot {
+  WatchdogSTM32Boot() {
+#if defined(RCC_CSR_RMVF)
+    _resetFlags = RCC->CSR;
+    RCC->CSR |= RCC_CSR_RMVF;
+#endif
+  }
+} _boot;
+
+#if defined(STM32F4xx)
+// Restores the clock tree (PLL and all) the way the variant set it up at
+// boot, STOP mode leaves the core running from the HSI.
+extern "C" void SystemClock_Config(void);
+
+// The RTC wakeup timer's line on the EXTI.
+#define WATCHDOG_STM32_EXTI_RTC (1UL << 22)
+
+// Clocks the RTC from the LSI, unless something (the STM32RTC library, say)
+// set it up already.  Returns its clock in Hz, 0 if it runs from the HSE,
+// which stops in STOP mode.
+static uint32_t _rtcStart() {
+  RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+  PWR->CR |= PWR_CR_DBP; // Backup domain write access
+  if (!(RCC->BDCR & RCC_BDCR_RTCEN)) {
+    RCC->CSR |= RCC_CSR_LSION;
+    while (!(RCC->CSR & RCC_CSR_LSIRDY))
+      ;
+    RCC->BDCR = (RCC->BDCR & ~RCC_BDCR_RTCSEL) | RCC_BDCR_RTCSEL_1 |
+                RCC_BDCR_RTCEN;
+  }
+  switch (RCC->BDCR & RCC_BDCR_RTCSEL) {
+  case RCC_BDCR_RTCSEL_0:
+    return LSE_VALUE;
+  case RCC_BDCR_RTCSEL_1:
+    return LSI_VALUE;
+  default:
+    return 0;
+  }
+}
+
+// Time of day in RTC subsecond units, perSecond of them per second.  The
+// calendar shadow registers have to resync after STOP before they can be
+// read, and reading the subseconds locks them until the date is read.
+static uint32_t _rtcNow(uint32_t perSecond) {
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+  RTC->ISR &= ~RTC_ISR_RSF;
+  RTC->WPR = 0xFF;
+  while (!(RTC->ISR & RTC_ISR_RSF))
+    ;
+  uint32_t ssr = RTC->SSR;
+  uint32_t tr = RTC->TR;
+  (void)RTC->DR;
+  uint32_t h = ((tr >> 20) & 0x3) * 10 + ((tr >> 16) & 0xF);
+  uint32_t m = ((tr >> 12) & 0x7) * 10 + ((tr >> 8) & 0xF);
+  uint32_t s = ((tr >> 4) & 0x7) * 10 + (tr & 0xF);
+  return (h * 3600 + m * 60 + s) * perSecond + (perSecond - 1 - ssr);
+}
+
+// STOP mode until the RTC wakeup timer counts down ticks (of RTCCLK / 16)
+// or a sleepUntil() pin fires.  Returns whether the timer woke the chip.
+static bool _stopFor(uint32_t ticks) {
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+  RTC->CR &= ~RTC_CR_WUTE;
+  while (!(RTC->ISR & RTC_ISR_WUTWF))
+    ;
+  RTC->WUTR = ticks - 1;
+  RTC->CR &= ~RTC_CR_WUCKSEL; // RTCCLK / 16
+  RTC->ISR &= ~RTC_ISR_WUTF;
+  RTC->CR |= RTC_CR_WUTIE | RTC_CR_WUTE;
+  RTC->WPR = 0xFF;
+  // As an event rather than an interrupt, so there's no handler to share
+  // with the STM32RTC library.
+  EXTI->PR = WATCHDOG_STM32_EXTI_RTC;
+  EXTI->RTSR |= WATCHDOG_STM32_EXTI_RTC;
+  EXTI->EMR |= WATCHDOG_STM32_EXTI_RTC;
+
+  // Deep sleep is STOP (not standby), with the regulator in low power.
+  PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPDS;
+  SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SEVONPEND_Msk;
+
+  // With SEVONPEND, an interrupt that comes up while they are masked still
+  // wakes the WFE, so a sleepUntil() pin can't slip in between the check
+  // and the WFE.  A stale event only makes the first WFE return early.
+  // Other interrupts wake the chip briefly.
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP);
+  __disable_irq();
+  while (!(RTC->ISR & RTC_ISR_WUTF) && !WatchdogWake::pending()) {
+    __WFE();
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_WAKE);
+  SCB->SCR &= ~(SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SEVONPEND_Msk);
+
+  bool timer = RTC->ISR & RTC_ISR_WUTF;
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+  RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUTIE);
+  RTC->ISR &= ~RTC_ISR_WUTF;
+  RTC->WPR = 0xFF;
+  EXTI->EMR &= ~WATCHDOG_STM32_EXTI_RTC;
+  EXTI->PR = WATCHDOG_STM32_EXTI_RTC;
+  return timer;
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Starts the independent watchdog, which can't be stopped again
+            (other than by a reset).
+    @param    maxPeriodMS
+              Timeout period of the IWDG in milliseconds, 0 for the longest
+              (about 32 seconds).
+    @return The actual period (in milliseconds) before a watchdog timer
+            reset, rounded down to what the prescaler and reload value can
+            do, or 0 on error.
+*/
+/**************************************************************************/
+int WatchdogSTM32::enable(int maxPeriodMS) {
+  if (maxPeriodMS < 0)
+    return 0;
+  if (maxPeriodMS == 0 || maxPeriodMS > maxPeriod)
+    maxPeriodMS = maxPeriod;
+
+  // Smallest prescaler (LSI / 4 << pr) the 12 bit reload value fits with,
+  // for the finest steps.
+  uint32_t clocks = (uint64_t)maxPeriodMS * LSI_VALUE / 1000;
+  uint8_t pr = 0;
+  while (pr < 6 && clocks > (4UL << pr) * 4096)
+    pr++;
+  uint32_t reload = clocks / (4UL << pr);
+  if (reload < 1)
+    reload = 1;
+  if (reload > 4096)
+    reload = 4096;
+
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLE);
+  IWDG->KR = 0xCCCC; // Start (for good)
+  IWDG->KR = 0x5555; // Unlock PR and RLR
+  IWDG->PR = pr;
+  IWDG->RLR = reload - 1;
+  while (IWDG->SR) // Wait for the LSI clock domain to take them
+    ;
+  IWDG->KR = 0xAAAA;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_ENABLED);
+
+  _wdto = (uint64_t)reload * (4UL << pr) * 1000 / LSI_VALUE;
+  if (!_wdto)
+    _wdto = 1;
+  return _wdto;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reload the watchdog counter with the amount of time set in
+            enable().
+*/
+/**************************************************************************/
+void WatchdogSTM32::reset() {
+  IWDG->KR = 0xAAAA;
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_RESET);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Changes the timeout of the running watchdog (and kicks it), for
+            instance ahead of a long flash write.  See WatchdogExtend for a
+            guard that restores it afterwards.
+    @param    maxPeriodMS
+              New timeout, in milliseconds, capped like enable()'s.
+    @return The previous timeout to hand back to restore(), 0 if the
+            watchdog is off (and then nothing changes).
+*/
+/**************************************************************************/
+int WatchdogSTM32::extend(int maxPeriodMS) {
+  int prev = _wdto;
+  if (prev && maxPeriodMS > 0)
+    enable(maxPeriodMS);
+  return prev;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Goes back to the timeout extend() returned, kicking the
+            watchdog.
+    @param    prev
+              Value returned by extend().
+*/
+/**************************************************************************/
+void WatchdogSTM32::restore(int prev) {
+  if (prev > 0)
+    enable(prev);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Once enabled, the STM32's IWDG can NOT be disabled.
+*/
+/**************************************************************************/
+void WatchdogSTM32::disable() {}
+
+/**************************************************************************/
+/*!
+    @brief  Puts the STM32F4 in STOP mode (a few hundred uA on an F405,
+            RAM kept) until the RTC wakeup timer goes off.  The RTC is
+            clocked from the LSI unless it was set up already.  The IWDG
+            keeps counting in STOP, so with it on the chip wakes up every
+            half period to kick it.  On the way out the clock tree is set
+            up again with SystemClock_Config() and millis() moves on by
+            the time slept, measured on the RTC calendar.
+    @param    maxPeriodMS
+              Time to sleep, in milliseconds.
+    @return The actual period (in milliseconds) that the hardware was
+            asleep, 0 if it couldn't sleep (other STM32 series, or an RTC
+            running from the HSE).
+*/
+/**************************************************************************/
+int WatchdogSTM32::sleep(int maxPeriodMS) {
+#if defined(STM32F4xx)
+  if (maxPeriodMS <= 0)
+    return 0;
+  uint32_t rtcHz = _rtcStart();
+  if (!rtcHz)
+    return 0;
+  uint32_t tickHz = rtcHz / 16;
+  uint32_t perSecond = (RTC->PRER & RTC_PRER_PREDIV_S) + 1;
+  int chunkMS = 65536UL * 1000 / tickHz; // 16 bit wakeup counter
+  if (_wdto && chunkMS > _wdto / 2)
+    chunkMS = _wdto > 1 ? _wdto / 2 : 1;
+
+  WatchdogEnergy::sleepBegin();
+  // SysTick stops with the core clock anyway, and its interrupt would end
+  // the WFE every millisecond while the core runs.
+  SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk;
+  int slept = 0;
+  bool early = false;
+  while (slept < maxPeriodMS) {
+    int ms = maxPeriodMS - slept;
+    if (ms > chunkMS)
+      ms = chunkMS;
+    uint32_t ticks = (uint32_t)ms * tickHz / 1000;
+    uint32_t start = _rtcNow(perSecond);
+    if (_stopFor(ticks ? ticks : 1)) {
+      slept += ms;
+    } else {
+      // Woken up early, see how far it got (wrapping around midnight).
+      uint32_t day = 86400 * perSecond;
+      uint32_t units = (_rtcNow(perSecond) + day - start) % day;
+      slept += units * 1000 / perSecond;
+      early = true;
+    }
+    if (_wdto)
+      reset();
+    if (early)
+      break;
+  }
+
+  SystemClock_Config();
+  SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;
+  uwTick += slept; // millis()
+  WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_STOP, slept, early);
+  WATCHDOG_TRACE_EVENT(WATCHDOG_TRACE_SLEEP_RETURN);
+  return slept;
+#else
+  (void)maxPeriodMS;
+  return 0;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Raw reset flags, as RCC_CSR had them at boot before they were
+            cleared.  For instance, (Watchdog.resetFlags() &
+            RCC_CSR_IWDGRSTF) tells what IWatchdog.isReset() used to.
+    @return RCC_CSR at boot, 0 if the series has no reset flags there.
+*/
+/**************************************************************************/
+uint32_t WatchdogSTM32::resetFlags() { return _resetFlags; }
+
+/**************************************************************************/
+/*!
+    @brief  Decodes the cause of the last reset.
+    @return The cause of the last reset.
+*/
+/**************************************************************************/
+WatchdogResetCause WatchdogSTM32::resetReason() {
+#if defined(RCC_CSR_RMVF)
+  // The reset pin flag comes with every other cause, it goes last.
+  if (_resetFlags & (RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF))
+    return WATCHDOG_RESET_WATCHDOG;
+  if (_resetFlags & RCC_CSR_SFTRSTF)
+    return WATCHDOG_RESET_SOFTWARE;
+#if defined(RCC_CSR_PORRSTF)
+  if (_resetFlags & RCC_CSR_PORRSTF)
+    return WATCHDOG_RESET_POWER_ON;
+#endif
+#if defined(RCC_CSR_BORRSTF)
+  if (_resetFlags & RCC_CSR_BORRSTF)
+    return WATCHDOG_RESET_BROWNOUT;
+#endif
+  if (_resetFlags & RCC_CSR_PINRSTF)
+    return WATCHDOG_RESET_EXTERNAL;
+#endif
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+#endif // ARDUINO_ARCH_STM32
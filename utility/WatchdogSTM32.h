@@ -0,0 +1,65 @@
+/*!
+ * @file WatchdogSTM32.h
+ *
+ * Support for the STM32 independent watchdog (IWDG) and STOP mode sleep,
+ * on the STM32duino core.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGSTM32_H_
+#define WATCHDOGSTM32_H_
+
+#include <Arduino.h>
+
+#include "WatchdogBase.h"
+
+/**************************************************************************/
+/*!
+    @brief  Class that contains functions for interacting with the STM32's
+            independent watchdog, clocked by the ~32 kHz LSI oscillator,
+            and its STOP mode (STM32F4 only).
+*/
+/**************************************************************************/
+class WatchdogSTM32 : public WatchdogBase<WatchdogSTM32> {
+public:
+  WatchdogSTM32() : _wdto(0){};
+
+  /// Capabilities, for generic code to branch on at compile time (see
+  /// WatchdogBase.h).  The IWDG counts LSI clocks divided by 4 to 256,
+  /// from a 12 bit reload value.
+  static constexpr bool canDisable = false;
+  static constexpr int32_t minPeriod = 1;
+  static constexpr int32_t maxPeriod = 4096ULL * 256 * 1000 / LSI_VALUE;
+  static constexpr int32_t periodGranularity = 256ULL * 1000 / LSI_VALUE;
+#if defined(STM32F4xx)
+  static constexpr bool supportsSleep = true;
+#else
+  static constexpr bool supportsSleep = false;
+#endif
+  static constexpr bool stateSurvivesWake = false;
+
+  int enable(int maxPeriodMS = 0);
+  void disable()
+      __attribute__((error("STM32 IWDG cannot be disabled once enabled")));
+  void reset();
+  /*!
+      @brief  Tells the current timeout (extended or not).
+      @return The timeout in milliseconds, 0 when off.
+  */
+  int period() { return _wdto; }
+  int extend(int maxPeriodMS);
+  void restore(int prev);
+  int sleep(int maxPeriodMS = 0);
+  WatchdogResetCause resetReason();
+  uint32_t resetFlags();
+
+private:
+  int _wdto;
+};
+
+#endif // WATCHDOGSTM32_H_
@@ -0,0 +1,201 @@
+#if defined(__linux__)
+
+#include "WatchdogSystemd.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**************************************************************************/
+/*!
+    @brief  Turns on kicking the systemd service watchdog.
+    @param    maxPeriodMS
+              Timeout in milliseconds, which overrides the unit's
+              WatchdogSec= (WATCHDOG_USEC=), or 0 to keep WatchdogSec=.
+    @return The timeout in milliseconds, 0 if the process isn't a service
+            with a watchdog (no $NOTIFY_SOCKET, $WATCHDOG_PID is another
+            process, or no WatchdogSec= and no maxPeriodMS).
+*/
+/**************************************************************************/
+int WatchdogSystemd::enable(int maxPeriodMS) {
+  if (maxPeriodMS < 0 || !_open())
+    return 0;
+
+  const char *usec = getenv("WATCHDOG_USEC");
+  unsigned long long unitMS = usec ? strtoull(usec, NULL, 10) / 1000 : 0;
+  if (unitMS > (unsigned long long)maxPeriod)
+    unitMS = maxPeriod;
+  if (!maxPeriodMS)
+    maxPeriodMS = (int)unitMS;
+  if (!maxPeriodMS)
+    return 0;
+
+  // Only tell systemd about timeouts it doesn't already have, that kicks
+  // the watchdog as well.
+  if (maxPeriodMS != (_wdto ? _wdto : (int)unitMS))
+    _setPeriod(maxPeriodMS);
+  else
+    reset();
+  _wdto = maxPeriodMS;
+  return _wdto;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Kicks the watchdog: a single send() on the socket enable()
+            connected, which doesn't block or allocate.
+*/
+/**************************************************************************/
+void WatchdogSystemd::reset() {
+  static const char kick[] = "WATCHDOG=1";
+  if (_fd < 0)
+    return;
+  if (send(_fd, kick, sizeof(kick) - 1, MSG_NOSIGNAL | MSG_DONTWAIT) >= 0 ||
+      errno != ECONNREFUSED)
+    return;
+  // systemd re-executed itself and bound $NOTIFY_SOCKET again, connect to
+  // the new one.
+  close(_fd);
+  _fd = -1;
+  if (_open())
+    send(_fd, kick, sizeof(kick) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Changes the service's timeout (and kicks it), for instance
+            ahead of a long operation.  See WatchdogExtend for a guard
+            that restores it afterwards.
+    @param    maxPeriodMS
+              New timeout, in milliseconds.
+    @return The previous timeout to hand back to restore(), 0 if the
+            watchdog is off (and then nothing changes).
+*/
+/**************************************************************************/
+int WatchdogSystemd::extend(int maxPeriodMS) {
+  int prev = _wdto;
+  if (prev && maxPeriodMS > 0) {
+    _setPeriod(maxPeriodMS);
+    _wdto = maxPeriodMS;
+  }
+  return prev;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Goes back to the timeout extend() returned, kicking the
+            watchdog.
+    @param    prev
+              Value returned by extend().
+*/
+/**************************************************************************/
+void WatchdogSystemd::restore(int prev) {
+  if (prev > 0) {
+    _setPeriod(prev);
+    _wdto = prev;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  The service watchdog is set up by the unit (WatchdogSec=), the
+            service itself can't turn it off.
+*/
+/**************************************************************************/
+void WatchdogSystemd::disable() {}
+
+/**************************************************************************/
+/*!
+    @brief  Sleeps the process, kicking the watchdog every half period
+            meanwhile so that it doesn't bite, like the hardware backends
+            that pause their watchdog during sleep.
+    @param    maxPeriodMS
+              Time to sleep, in milliseconds.
+    @return The time actually slept, in milliseconds.
+*/
+/**************************************************************************/
+int WatchdogSystemd::sleep(int maxPeriodMS) {
+  if (maxPeriodMS <= 0)
+    return 0;
+  WatchdogEnergy::sleepBegin();
+  uint32_t start = watchdog_millis();
+  int slept = 0;
+  while (slept < maxPeriodMS) {
+    int ms = maxPeriodMS - slept;
+    if (_wdto && ms > _wdto / 2)
+      ms = _wdto > 1 ? _wdto / 2 : 1;
+    // Signals cut it short, the loop sleeps what is left
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+    reset();
+    slept = (int)(watchdog_millis() - start);
+  }
+  WatchdogEnergy::sleepEnd(WATCHDOG_SLEEP_IDLE, slept, false);
+  return slept;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decodes the cause of the last reset.
+    @return WATCHDOG_RESET_UNKNOWN, a restarted service isn't told why
+            systemd restarted it.
+*/
+/**************************************************************************/
+WatchdogResetCause WatchdogSystemd::resetReason() {
+  return WATCHDOG_RESET_UNKNOWN;
+}
+
+// Opens a datagram socket to $NOTIFY_SOCKET and connects it, so that kicks
+// don't have to address (or allocate) anything.
+bool WatchdogSystemd::_open() {
+  if (_fd >= 0)
+    return true;
+  // Set when the watchdog is meant for one process of the service only.
+  const char *pid = getenv("WATCHDOG_PID");
+  if (pid && (pid_t)strtoul(pid, NULL, 10) != getpid())
+    return false;
+  const char *path = getenv("NOTIFY_SOCKET");
+  if (!path || (path[0] != '/' && path[0] != '@'))
+    return false; // Not run by systemd (or a vsock address)
+
+  struct sockaddr_un addr;
+  size_t len = strlen(path);
+  if (len >= sizeof(addr.sun_path))
+    return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path, len);
+  if (path[0] == '@')
+    addr.sun_path[0] = 0; // Abstract namespace
+
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return false;
+  if (connect(fd, (struct sockaddr *)&addr,
+              offsetof(struct sockaddr_un, sun_path) + len) < 0) {
+    close(fd);
+    return false;
+  }
+  _fd = fd;
+  return true;
+}
+
+// Sends a notification, one datagram like sd_notify().
+bool WatchdogSystemd::_notify(const char *msg) {
+  return _fd >= 0 && send(_fd, msg, strlen(msg), MSG_NOSIGNAL) >= 0;
+}
+
+// Overrides the unit's WatchdogSec=, which also restarts the timeout.
+void WatchdogSystemd::_setPeriod(int maxPeriodMS) {
+  char msg[48];
+  snprintf(msg, sizeof(msg), "WATCHDOG_USEC=%llu\nWATCHDOG=1",
+           (unsigned long long)maxPeriodMS * 1000);
+  _notify(msg);
+}
+
+#endif // __linux__
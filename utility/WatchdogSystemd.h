@@ -0,0 +1,66 @@
+/*!
+ * @file WatchdogSystemd.h
+ *
+ * Support for the systemd service watchdog (WatchdogSec=), for sketches
+ * built for Linux and run as a service.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGSYSTEMD_H_
+#define WATCHDOGSYSTEMD_H_
+
+#include "WatchdogBase.h"
+
+/**************************************************************************/
+/*!
+    @brief  Class that drives the systemd service watchdog: kicks are
+            WATCHDOG=1 datagrams to $NOTIFY_SOCKET, sent on a socket
+            opened and connected once by enable(), and enable(ms) changes
+            the service's timeout with WATCHDOG_USEC=.
+*/
+/**************************************************************************/
+class WatchdogSystemd : public WatchdogBase<WatchdogSystemd> {
+public:
+  WatchdogSystemd() : _fd(-1), _wdto(0){};
+
+  /// Capabilities, for generic code to branch on at compile time (see
+  /// WatchdogBase.h).
+  static constexpr bool canDisable = false;
+  static constexpr int32_t minPeriod = 1;
+  static constexpr int32_t maxPeriod = 0x7FFFFFFF;
+  static constexpr int32_t periodGranularity = 1;
+  static constexpr bool supportsSleep = false;
+  static constexpr bool stateSurvivesWake = false;
+
+  int enable(int maxPeriodMS = 0);
+  void disable()
+      __attribute__((error("systemd's watchdog is set in the service unit")));
+  void reset();
+  /*!
+      @brief  Tells the current timeout (extended or not).
+      @return The timeout in milliseconds, 0 when off.
+  */
+  int period() { return _wdto; }
+  int extend(int maxPeriodMS);
+  void restore(int prev);
+  int sleep(int maxPeriodMS = 0);
+  int sleepUntil(const WatchdogWakeSource *sources, uint8_t count,
+                 int maxPeriodMS = 0)
+      __attribute__((error("no pin interrupts to wake on under Linux")));
+  WatchdogResetCause resetReason();
+
+private:
+  bool _open();
+  bool _notify(const char *msg);
+  void _setPeriod(int maxPeriodMS);
+
+  int _fd;
+  int _wdto;
+};
+
+#endif // WATCHDOGSYSTEMD_H_
@@ -0,0 +1,184 @@
+#if defined(__linux__)
+
+#include "WatchdogThreads.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+WatchdogThreadSlot WatchdogThreads::_slots[WATCHDOG_THREADS_MAX];
+std::atomic<bool> WatchdogThreads::_tripped(false);
+
+// What the monitor knows of each slot, only ever touched by the monitor
+// thread, away from the heartbeats.
+static struct {
+  bool armed;      // Slot seen in use
+  bool late;       // Already acted on, until the next heartbeat
+  uint32_t beats;  // Heartbeat count last seen
+  uint64_t seenNS; // When it last moved
+} _watch[WATCHDOG_THREADS_MAX];
+
+// add() and remove() only, kicks and the monitor don't take it.
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t _thread;
+static std::atomic<bool> _running(false);
+static int _timer = -1;
+static WatchdogThreadsAction _action;
+static WatchdogThreadsHandler _handler;
+static void (*_kick)(void);
+
+static uint64_t _nowNS() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Starts the monitor thread.
+    @param  action
+            What to do about a thread that misses its deadline.
+    @param  handler
+            Called first in any case (from the monitor thread), or NULL.
+    @param  kick
+            Kicks the process watchdog, called on every check until a
+            thread misses its deadline with WATCHDOG_THREADS_STOP_KICKING,
+            or NULL.  Make it cheap for short checkMS, e.g.
+            Watchdog.resetIfDue().
+    @param  checkMS
+            Time between two checks, which is how late a hung thread can
+            be noticed past its timeout.
+    @return True on success, false if already running or the timer or
+            thread couldn't be created.
+*/
+/**************************************************************************/
+bool WatchdogThreads::begin(WatchdogThreadsAction action,
+                            WatchdogThreadsHandler handler,
+                            void (*kick)(void), int checkMS) {
+  if (_running || checkMS <= 0)
+    return false;
+  _timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (_timer < 0)
+    return false;
+  struct itimerspec period;
+  period.it_interval.tv_sec = checkMS / 1000;
+  period.it_interval.tv_nsec = (checkMS % 1000) * 1000000L;
+  period.it_value = period.it_interval;
+  timerfd_settime(_timer, 0, &period, NULL);
+
+  _action = action;
+  _handler = handler;
+  _kick = kick;
+  _tripped = false;
+  _running = true;
+  if (pthread_create(&_thread, NULL, _monitor, NULL)) {
+    _running = false;
+    close(_timer);
+    _timer = -1;
+    return false;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stops the monitor thread, within checkMS.  Kicks stop with it.
+*/
+/**************************************************************************/
+void WatchdogThreads::end() {
+  if (!_running)
+    return;
+  _running = false;
+  pthread_join(_thread, NULL);
+  close(_timer);
+  _timer = -1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Starts watching the calling thread, which then has to kick()
+            its slot at least every timeoutMS.
+    @param  name
+            Name for the handler, which must stay valid until remove().
+    @param  timeoutMS
+            Longest time allowed between two kicks, in milliseconds.
+    @return Slot to kick(), -1 if all WATCHDOG_THREADS_MAX are taken.
+*/
+/**************************************************************************/
+int WatchdogThreads::add(const char *name, int timeoutMS) {
+  if (timeoutMS <= 0)
+    return -1;
+  int slot = -1;
+  pthread_mutex_lock(&_lock);
+  for (int i = 0; i < WATCHDOG_THREADS_MAX; i++) {
+    if (!_slots[i].timeoutMS.load(std::memory_order_relaxed)) {
+      slot = i;
+      _slots[i].name = name;
+      // First heartbeat, so the monitor starts the clock from here even if
+      // the slot was freed and taken again since it last looked.
+      kick(i);
+      _slots[i].timeoutMS.store(timeoutMS, std::memory_order_release);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  return slot;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stops watching a thread, before it exits or blocks for good.
+    @param  slot
+            Slot add() returned.
+*/
+/**************************************************************************/
+void WatchdogThreads::remove(int slot) {
+  if (slot < 0 || slot >= WATCHDOG_THREADS_MAX)
+    return;
+  pthread_mutex_lock(&_lock);
+  _slots[slot].timeoutMS.store(0, std::memory_order_release);
+  pthread_mutex_unlock(&_lock);
+}
+
+// The monitor thread: one pass over the slots per timer tick.
+void *WatchdogThreads::_monitor(void *arg) {
+  (void)arg;
+  uint64_t ticks;
+  while (_running) {
+    if (read(_timer, &ticks, sizeof(ticks)) != sizeof(ticks))
+      continue;
+    uint64_t now = _nowNS();
+    for (int i = 0; i < WATCHDOG_THREADS_MAX; i++) {
+      int32_t timeoutMS = _slots[i].timeoutMS.load(std::memory_order_acquire);
+      if (!timeoutMS) {
+        _watch[i].armed = false;
+        continue;
+      }
+      uint32_t beats = _slots[i].beats.load(std::memory_order_relaxed);
+      if (!_watch[i].armed || beats != _watch[i].beats) {
+        _watch[i].armed = true;
+        _watch[i].late = false;
+        _watch[i].beats = beats;
+        _watch[i].seenNS = now;
+        continue;
+      }
+      if (now - _watch[i].seenNS <= (uint64_t)timeoutMS * 1000000ULL)
+        continue;
+      if (_watch[i].late)
+        continue; // Already acted on
+      _watch[i].late = true;
+      if (_handler)
+        _handler(i, _slots[i].name);
+      if (_action == WATCHDOG_THREADS_ABORT)
+        abort();
+      if (_action == WATCHDOG_THREADS_STOP_KICKING)
+        _tripped = true;
+    }
+    if (_kick && !_tripped)
+      _kick();
+  }
+  return NULL;
+}
+
+#endif // __linux__
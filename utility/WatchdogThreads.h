@@ -0,0 +1,100 @@
+/*!
+ * @file WatchdogThreads.h
+ *
+ * Software watchdog for the threads of a Linux process: every thread kicks
+ * its own heartbeat, and a monitor thread acts on the ones that stop, so
+ * a single hung worker doesn't go unnoticed while the main thread keeps
+ * kicking the systemd watchdog.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGTHREADS_H_
+#define WATCHDOGTHREADS_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef WATCHDOG_THREADS_MAX
+/** Most threads watched at once. */
+#define WATCHDOG_THREADS_MAX 256
+#endif
+
+#ifndef WATCHDOG_THREADS_LINE
+/** Cache line size, each heartbeat gets a line of its own. */
+#define WATCHDOG_THREADS_LINE 64
+#endif
+
+/** What the monitor does about a thread that missed its deadline. */
+typedef enum {
+  WATCHDOG_THREADS_CALLBACK,     ///< Only call the handler
+  WATCHDOG_THREADS_ABORT,        ///< abort(), for a core dump
+  WATCHDOG_THREADS_STOP_KICKING, ///< Stop kicking, the watchdog bites
+} WatchdogThreadsAction;
+
+/** Called by the monitor thread with the slot and name of a hung thread. */
+typedef void (*WatchdogThreadsHandler)(int slot, const char *name);
+
+/** Heartbeat of one thread, alone in its cache line. */
+struct alignas(WATCHDOG_THREADS_LINE) WatchdogThreadSlot {
+  std::atomic<uint32_t> beats;    ///< Bumped by kick(), owner thread only
+  std::atomic<int32_t> timeoutMS; ///< Deadline between kicks, 0 = free
+  const char *name;               ///< Name for the handler
+};
+
+/**************************************************************************/
+/*!
+    @brief  Per-thread heartbeats checked by a single monitor thread.  A
+            kick is a relaxed load and store on the thread's own cache
+            line: no locks, no atomic read-modify-write, and no sharing
+            between threads, so hundreds of them kick without contention.
+            The monitor wakes up on a timerfd every checkMS, notes which
+            heartbeats moved, acts on the ones that didn't for longer than
+            their timeout, and calls the kick function given to begin()
+            (Watchdog.resetIfDue(), say) to keep the process watchdog fed
+            until a hung thread makes it stop.
+*/
+/**************************************************************************/
+class WatchdogThreads {
+public:
+  static bool begin(WatchdogThreadsAction action,
+                    WatchdogThreadsHandler handler = NULL,
+                    void (*kick)(void) = NULL, int checkMS = 100);
+  static void end();
+  static int add(const char *name, int timeoutMS);
+  static void remove(int slot);
+
+  /*!
+      @brief  Heartbeat of the calling thread.
+      @param  slot
+              Slot add() returned to this thread (not -1), which must be
+              the only one to kick it.
+  */
+  static inline void kick(int slot) {
+    std::atomic<uint32_t> &beats = _slots[slot].beats;
+    beats.store(beats.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  }
+
+  /*!
+      @brief  Tells whether the monitor stopped kicking (with
+              WATCHDOG_THREADS_STOP_KICKING) because a thread hung.
+      @return True once it did.
+  */
+  static bool tripped() { return _tripped.load(std::memory_order_relaxed); }
+
+  /** Heartbeats, indexed by slot. */
+  static WatchdogThreadSlot _slots[WATCHDOG_THREADS_MAX];
+
+private:
+  static void *_monitor(void *arg);
+
+  static std::atomic<bool> _tripped;
+};
+
+#endif // WATCHDOGTHREADS_H_
@@ -0,0 +1,99 @@
+#include "WatchdogTrace.h"
+
+#ifdef WATCHDOG_TRACE
+
+WatchdogTraceEntry WatchdogTrace::_ring[WATCHDOG_TRACE_SIZE];
+volatile uint32_t WatchdogTrace::_head;
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+// Runs once before setup(): start the cycle counter (most cores leave it
+// off), ahead of any event worth timing.
+static struct WatchdogTraceBoot {
+  WatchdogTraceBoot() {
+    *(volatile uint32_t *)0xE000EDFC |= 1UL << 24; // DEMCR TRCENA
+    *(volatile uint32_t *)0xE0001000 |= 1UL;       // DWT_CTRL CYCCNTENA
+  }
+} _boot;
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Copy the recorded events out, oldest first.  Events recorded
+            while copying may or may not make it in.
+    @param  entries
+            Where to copy the events to.
+    @param  max
+            Room in entries.
+    @return Number of events copied, the most recent ones if there are
+            more than max.
+*/
+/**************************************************************************/
+uint16_t WatchdogTrace::snapshot(WatchdogTraceEntry *entries, uint16_t max) {
+#if defined(__AVR__)
+  noInterrupts(); // Takes four loads on AVR
+  uint32_t head = _head;
+  interrupts();
+#else
+  uint32_t head = _head;
+#endif
+  uint32_t count = head < WATCHDOG_TRACE_SIZE ? head : WATCHDOG_TRACE_SIZE;
+  if (count > max)
+    count = max;
+  for (uint32_t i = 0; i < count; i++)
+    entries[i] = _ring[(head - count + i) & (WATCHDOG_TRACE_SIZE - 1)];
+  return count;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Forget the events recorded so far.
+*/
+/**************************************************************************/
+void WatchdogTrace::clear() {
+#if defined(__AVR__)
+  noInterrupts();
+  _head = 0;
+  interrupts();
+#else
+  _head = 0;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Name an event, for printing.
+    @param  event
+            A WatchdogTraceEvent.
+    @return Its name, "?" if unknown.
+*/
+/**************************************************************************/
+const char *WatchdogTrace::name(uint8_t event) {
+  switch (event) {
+  case WATCHDOG_TRACE_ENABLE:
+    return "enable";
+  case WATCHDOG_TRACE_ENABLED:
+    return "enabled";
+  case WATCHDOG_TRACE_RESET:
+    return "reset";
+  case WATCHDOG_TRACE_SYNC_BEGIN:
+    return "sync_begin";
+  case WATCHDOG_TRACE_SYNC_END:
+    return "sync_end";
+  case WATCHDOG_TRACE_INIT_BEGIN:
+    return "init_begin";
+  case WATCHDOG_TRACE_INIT_END:
+    return "init_end";
+  case WATCHDOG_TRACE_SLEEP:
+    return "sleep";
+  case WATCHDOG_TRACE_WAKE:
+    return "wake";
+  case WATCHDOG_TRACE_SLEEP_RETURN:
+    return "sleep_return";
+  case WATCHDOG_TRACE_ISR:
+    return "isr";
+  default:
+    return "?";
+  }
+}
+
+#endif // WATCHDOG_TRACE
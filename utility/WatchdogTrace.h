@@ -0,0 +1,130 @@
+/*!
+ * @file WatchdogTrace.h
+ *
+ * Optional trace of what the watchdog backends spend their time on:
+ * timestamped events at enable, reset, sleep, wake and interrupt points,
+ * kept in a ring buffer.  Build with WATCHDOG_TRACE defined (a compiler
+ * flag, so that the library sees it too) to turn it on; otherwise the
+ * hooks compile to nothing.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGTRACE_H_
+#define WATCHDOGTRACE_H_
+
+#include <stdint.h>
+
+/** Traced events. */
+typedef enum {
+  WATCHDOG_TRACE_ENABLE = 1,   ///< enable() started
+  WATCHDOG_TRACE_ENABLED,      ///< enable() has the watchdog running
+  WATCHDOG_TRACE_RESET,        ///< reset() kicked the watchdog
+  WATCHDOG_TRACE_SYNC_BEGIN,   ///< Waiting for a clock domain sync (SAMD)
+  WATCHDOG_TRACE_SYNC_END,     ///< Clock domain sync done
+  WATCHDOG_TRACE_INIT_BEGIN,   ///< One-time hardware setup started
+  WATCHDOG_TRACE_INIT_END,     ///< One-time hardware setup done
+  WATCHDOG_TRACE_SLEEP,        ///< About to go to sleep (WFI or the like)
+  WATCHDOG_TRACE_WAKE,         ///< Back from sleep
+  WATCHDOG_TRACE_SLEEP_RETURN, ///< sleep() returning
+  WATCHDOG_TRACE_ISR,          ///< Watchdog interrupt
+} WatchdogTraceEvent;
+
+#ifdef WATCHDOG_TRACE
+
+#include <Arduino.h>
+
+#ifndef WATCHDOG_TRACE_SIZE
+/** Number of events kept, must be a power of two. */
+#define WATCHDOG_TRACE_SIZE 32
+#endif
+
+// Timestamps come from the core's cycle counter where there is one that can
+// be read in a single instruction, micros() otherwise.
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define WATCHDOG_TRACE_CYCLES 1
+#define WATCHDOG_TRACE_NOW() (*(volatile uint32_t *)0xE0001004) // DWT CYCCNT
+#elif defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+#include <Esp.h>
+#define WATCHDOG_TRACE_CYCLES 1
+#define WATCHDOG_TRACE_NOW() (ESP.getCycleCount())
+#else
+/** Whether timestamps count CPU cycles (1) or microseconds (0). */
+#define WATCHDOG_TRACE_CYCLES 0
+/** Current timestamp. */
+#define WATCHDOG_TRACE_NOW() ((uint32_t)micros())
+#endif
+
+/** Record an event, from any context. */
+#define WATCHDOG_TRACE_EVENT(event) WatchdogTrace::record(event)
+
+/** One traced event. */
+typedef struct {
+  uint32_t time; ///< Cycles or microseconds, see WATCHDOG_TRACE_CYCLES
+  uint8_t event; ///< WatchdogTraceEvent
+} WatchdogTraceEntry;
+
+/**************************************************************************/
+/*!
+    @brief  Ring buffer of the last WATCHDOG_TRACE_SIZE events.  Writers
+            claim a slot with an atomic increment where the core has one
+            (ARMv7-M, ESP32), so an interrupt can trace in the middle of a
+            traced reset() without either one waiting; elsewhere they mask
+            interrupts for the few instructions it takes.
+*/
+/**************************************************************************/
+class WatchdogTrace {
+public:
+  /*!
+      @brief  Record an event.  Inlined, so that it can run from ISRs kept
+              in IRAM (ESP32, ESP8266).
+      @param  event
+              A WatchdogTraceEvent.
+  */
+  static inline __attribute__((always_inline)) void record(uint8_t event) {
+    uint32_t now = WATCHDOG_TRACE_NOW();
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) ||                  \
+    defined(ARDUINO_ARCH_ESP32)
+    uint32_t i = __atomic_fetch_add(&_head, 1, __ATOMIC_RELAXED);
+#elif defined(__arm__)
+    uint32_t primask;
+    __asm__ volatile("mrs %0, primask\n cpsid i" : "=r"(primask)::"memory");
+    uint32_t i = _head++;
+    __asm__ volatile("msr primask, %0" ::"r"(primask) : "memory");
+#elif defined(ARDUINO_ARCH_ESP8266)
+    uint32_t ps = xt_rsil(15);
+    uint32_t i = _head++;
+    xt_wsr_ps(ps);
+#else
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t i = _head++;
+    SREG = sreg;
+#endif
+    WatchdogTraceEntry &entry = _ring[i & (WATCHDOG_TRACE_SIZE - 1)];
+    entry.time = now;
+    entry.event = event;
+  }
+
+  static uint16_t snapshot(WatchdogTraceEntry *entries, uint16_t max);
+  static void clear();
+  static const char *name(uint8_t event);
+
+  /** Recorded events, the oldest overwritten first. */
+  static WatchdogTraceEntry _ring[WATCHDOG_TRACE_SIZE];
+  /** Total number of events recorded. */
+  static volatile uint32_t _head;
+};
+
+#else
+
+/** Record an event, compiled out without WATCHDOG_TRACE. */
+#define WATCHDOG_TRACE_EVENT(event) ((void)0)
+
+#endif // WATCHDOG_TRACE
+
+#endif // WATCHDOGTRACE_H_
@@ -0,0 +1,169 @@
+#ifdef ARDUINO // Not for the Linux backend
+
+#include <Arduino.h>
+
+#include "WatchdogWake.h"
+
+// attachInterrupt() takes a PinStatus on cores built on ArduinoCore-API.
+#ifdef ARDUINO_API_VERSION
+#define WATCHDOG_WAKE_MODE(mode) ((PinStatus)(mode))
+#else
+#define WATCHDOG_WAKE_MODE(mode) (mode)
+#endif
+
+volatile int8_t WatchdogWake::_fired = -1;
+const WatchdogWakeSource *WatchdogWake::_sources = NULL;
+uint8_t WatchdogWake::_count = 0;
+
+// One handler per source, so the interrupt itself tells which one fired.
+// The first one wins.
+template <int8_t index> static void _wakeIsr(void) {
+  if (WatchdogWake::_fired < 0)
+    WatchdogWake::_fired = index;
+}
+
+static void (*const _wakeIsrs[WATCHDOG_WAKE_SOURCES])(void) = {
+    _wakeIsr<0>, _wakeIsr<1>, _wakeIsr<2>, _wakeIsr<3>};
+
+#if defined(ARDUINO_ARCH_SAMD)
+// Standby stops the clock the core runs the EIC from, so it wouldn't see
+// edges.  The SAMD51 can detect them asynchronously instead; the SAMD21
+// needs the EIC on a clock that keeps running in standby (generator 6, from
+// the ultra low power 32 kHz oscillator, like ArduinoLowPower does) and its
+// wake-up enabled.
+static void _wakeFromStandby(uint8_t pin, bool enable) {
+  uint32_t in = g_APinDescription[pin].ulExtInt;
+  if (in >= 16) // Not an EIC line (or the NMI)
+    return;
+#if defined(__SAMD51__)
+  EIC->CTRLA.bit.ENABLE = 0; // ASYNCH is enable-protected
+  while (EIC->SYNCBUSY.bit.ENABLE)
+    ;
+  if (enable)
+    EIC->ASYNCH.reg |= 1 << in;
+  else
+    EIC->ASYNCH.reg &= ~(1 << in);
+  EIC->CTRLA.bit.ENABLE = 1;
+  while (EIC->SYNCBUSY.bit.ENABLE)
+    ;
+#else
+  if (enable)
+    EIC->WAKEUP.reg |= 1 << in;
+  else
+    EIC->WAKEUP.reg &= ~(1 << in);
+#endif
+}
+
+#if !defined(__SAMD51__)
+// Generator 6 and EIC clock setups as they were before attach(), which
+// detach() puts back, so that the sketch's other interrupts get their
+// usual EIC clock (and filtering) again and its own use of generator 6
+// survives.  Both registers are read by writing the ID of the generator or
+// clock to read first.
+static uint32_t _savedGenctrl;
+static uint16_t _savedClkctrl;
+static bool _eicMoved;
+
+static void _eicClockMove(void) {
+  if (_eicMoved)
+    return;
+  *(volatile uint8_t *)&GCLK->GENCTRL.reg = 6;
+  while (GCLK->STATUS.bit.SYNCBUSY)
+    ;
+  _savedGenctrl = GCLK->GENCTRL.reg;
+  *(volatile uint8_t *)&GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EIC_Val;
+  _savedClkctrl = GCLK->CLKCTRL.reg;
+
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(6) | GCLK_GENCTRL_GENEN |
+                      GCLK_GENCTRL_SRC_OSCULP32K | GCLK_GENCTRL_RUNSTDBY;
+  while (GCLK->STATUS.bit.SYNCBUSY)
+    ;
+  GCLK->CLKCTRL.reg =
+      GCLK_CLKCTRL_ID_EIC | GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK6;
+  while (GCLK->STATUS.bit.SYNCBUSY)
+    ;
+  _eicMoved = true;
+}
+
+static void _eicClockRestore(void) {
+  if (!_eicMoved)
+    return;
+  // EIC back onto its generator first, then generator 6 as it was.
+  GCLK->CLKCTRL.reg = _savedClkctrl;
+  while (GCLK->STATUS.bit.SYNCBUSY)
+    ;
+  GCLK->GENCTRL.reg = _savedGenctrl;
+  while (GCLK->STATUS.bit.SYNCBUSY)
+    ;
+  _eicMoved = false;
+}
+#endif
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Attach an interrupt to each wake source pin.
+    @param  sources
+            Pins to wake on, which must stay valid until detach().
+    @param  count
+            Number of pins, only the first WATCHDOG_WAKE_SOURCES are used.
+*/
+/**************************************************************************/
+void WatchdogWake::attach(const WatchdogWakeSource *sources, uint8_t count) {
+  if (count > WATCHDOG_WAKE_SOURCES)
+    count = WATCHDOG_WAKE_SOURCES;
+  _fired = -1;
+  _sources = sources;
+  _count = count;
+  for (uint8_t i = 0; i < count; i++) {
+    attachInterrupt(digitalPinToInterrupt(sources[i].pin), _wakeIsrs[i],
+                    WATCHDOG_WAKE_MODE(sources[i].mode));
+#if defined(ARDUINO_ARCH_SAMD)
+    _wakeFromStandby(sources[i].pin, true);
+#endif
+  }
+#if defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+  if (count)
+    _eicClockMove();
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Detach the interrupts attach() set up.
+    @return Index of the source that fired first, WATCHDOG_WAKE_TIMEOUT if
+            none did.
+*/
+/**************************************************************************/
+int WatchdogWake::detach() {
+  for (uint8_t i = 0; i < _count; i++) {
+#if defined(ARDUINO_ARCH_SAMD)
+    _wakeFromStandby(_sources[i].pin, false);
+#endif
+    detachInterrupt(digitalPinToInterrupt(_sources[i].pin));
+  }
+#if defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+  _eicClockRestore();
+#endif
+  _count = 0;
+  return _fired >= 0 ? _fired : WATCHDOG_WAKE_TIMEOUT;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Tells whether sleepUntil() waits on an edge (RISING, FALLING or
+            CHANGE) of any pin, which AVR only sees with the I/O clock
+            running.
+    @return True if one of the attached sources is an edge.
+*/
+/**************************************************************************/
+bool WatchdogWake::edges() {
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t mode = _sources[i].mode;
+    if (mode == RISING || mode == FALLING || mode == CHANGE)
+      return true;
+  }
+  return false;
+}
+
+#endif // ARDUINO
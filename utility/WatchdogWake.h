@@ -0,0 +1,68 @@
+/*!
+ * @file WatchdogWake.h
+ *
+ * Pin wake sources for sleepUntil(), shared by the watchdog backends that
+ * wake up on pin interrupts.
+ *
+ * Adafruit invests time and resources providing this open source code,
+ * please support Adafruit and open-source hardware by purchasing
+ * products from Adafruit!
+ *
+ * MIT License, all text here must be included in any redistribution.
+ *
+ */
+#ifndef WATCHDOGWAKE_H_
+#define WATCHDOGWAKE_H_
+
+#include <stdint.h>
+
+/** Most pins sleepUntil() can wait on at once. */
+#define WATCHDOG_WAKE_SOURCES 4
+
+/** sleepUntil() result: the timeout ran out before any pin fired. */
+#define WATCHDOG_WAKE_TIMEOUT -1
+/** sleepUntil() result: woke up for another reason, or couldn't sleep. */
+#define WATCHDOG_WAKE_OTHER -2
+
+/** Pin to wake up on. */
+typedef struct {
+  uint8_t pin;  ///< Arduino pin number
+  uint8_t mode; ///< LOW, HIGH, RISING, FALLING or CHANGE, as attachInterrupt()
+} WatchdogWakeSource;
+
+/**************************************************************************/
+/*!
+    @brief  Attaches interrupts to the wake source pins for the duration of
+            a sleepUntil(), and notes which one fires first.  The backends'
+            sleep() checks pending() with interrupts masked before it goes
+            to sleep, and returns early once it is set, so a pin firing at
+            any point ends the sleep right away.
+*/
+/**************************************************************************/
+class WatchdogWake {
+public:
+  static void attach(const WatchdogWakeSource *sources, uint8_t count);
+  static int detach();
+
+  /*!
+      @brief  Tells whether a wake source fired since attach().
+      @return True if sleep() should return (or not go to sleep at all).
+  */
+  static bool pending() { return _fired >= 0; }
+
+  /*!
+      @brief  Tells whether sleepUntil() is waiting on wake sources.
+      @return True between attach() and detach().
+  */
+  static bool armed() { return _count != 0; }
+
+  static bool edges();
+
+  static volatile int8_t _fired; ///< Index of the source that fired, or -1
+
+private:
+  static const WatchdogWakeSource *_sources;
+  static uint8_t _count;
+};
+
+#endif // WATCHDOGWAKE_H_